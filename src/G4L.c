@@ -14,6 +14,14 @@
 #include "shader.h"
 #include "image.h"
 #include "texture.h"
+#include "atlas.h"
+#include "array.h"
+#include "vertexarray.h"
+#include "bufferpool.h"
+#include "transformfeedback.h"
+#include "uniformbuffer.h"
+#include "programcache.h"
+#include "preprocessor.h"
 
 static const char* TIMER_NAME = "G4L.timer";
 static lua_State* LUA = NULL;
@@ -327,12 +335,27 @@ int luaopen_G4L(lua_State* L)
 
 		// G4L stuff
 		{"bufferobject",   l_bufferobject_new},
+		{"streambuffer",   l_bufferobject_stream},
+		{"bufferpool",     l_bufferpool_new},
+		{"vertexarray",    l_vertexarray_new},
 		{"framebuffer",    l_framebuffer_new},
 		{"setFramebuffer", l_framebuffer_bind},
 		{"shader",         l_shader_new},
+		{"shaders",        l_shader_new_batch},
+		{"shaderVariant",  l_shader_variant},
+		{"shaderFile",     l_shader_file},
+		{"preprocess",     l_preprocess},
+		{"setShaderPath",  l_preprocessor_setPath},
 		{"setShader",      l_shader_set},
+		{"setShaderCache", l_programcache_set},
+		{"shaderCacheStats", l_programcache_stats},
+		{"transformFeedback", l_transform_feedback},
+		{"uniformbuffer",  l_uniformbuffer_new},
 		{"texture",        l_texture_new},
+		{"textureStats",   l_texture_stats},
+		{"atlas",          l_atlas_new},
 		{"image",          l_image_new},
+		{"array",          l_array_new},
 
 		// util
 		{"readFile",       l_readFile},
@@ -446,6 +469,10 @@ int luaopen_G4L(lua_State* L)
 		{"float",  GL_FLOAT},
 		{"double", GL_DOUBLE},
 
+		// transform feedback
+		{"interleaved_attribs", GL_INTERLEAVED_ATTRIBS},
+		{"separate_attribs",    GL_SEPARATE_ATTRIBS},
+
 		{NULL, 0}
 	};
 
@@ -540,6 +567,26 @@ int luaopen_G4L(lua_State* L)
 		// filter
 		{"nearest",         GL_NEAREST},
 		{"linear",          GL_LINEAR},
+		{"nearest_mipmap_nearest", GL_NEAREST_MIPMAP_NEAREST},
+		{"linear_mipmap_nearest",  GL_LINEAR_MIPMAP_NEAREST},
+		{"nearest_mipmap_linear",  GL_NEAREST_MIPMAP_LINEAR},
+		{"linear_mipmap_linear",   GL_LINEAR_MIPMAP_LINEAR},
+		{"trilinear",              GL_LINEAR_MIPMAP_LINEAR},
+
+		{NULL, 0}
+	};
+
+	l_constant_reg texture_format[] =
+	{
+		{"rgba8",              GL_RGBA8},
+		{"srgb8_alpha8",       GL_SRGB8_ALPHA8},
+		{"r8",                 GL_R8},
+		{"rg8",                GL_RG8},
+		{"r16f",               GL_R16F},
+		{"rgba16f",            GL_RGBA16F},
+		{"r32f",               GL_R32F},
+		{"depth24_stencil8",   GL_DEPTH24_STENCIL8},
+		{"depth_component32f", GL_DEPTH_COMPONENT32F},
 
 		{NULL, 0}
 	};
@@ -584,6 +631,10 @@ int luaopen_G4L(lua_State* L)
 	l_registerConstants(L, -1, texture_flags);
 	lua_setfield(L, -2, "texture_flags");
 
+	lua_newtable(L);
+	l_registerConstants(L, -1, texture_format);
+	lua_setfield(L, -2, "texture_format");
+
 	lua_newtable(L);
 	l_registerConstants(L, -1, draw_mode);
 	lua_setfield(L, -2, "draw_mode");
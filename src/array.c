@@ -0,0 +1,344 @@
+#include "array.h"
+#include "helper.h"
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include <glew.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char* INTERNAL_NAME = "G4L.array";
+
+// runs `...' for every element, with `p' pointing to the data of `a' and
+// `T' being the element type.
+#define _ARRAY_CASE(gltype, ctype, a, ...)                 \
+	case gltype: {                                         \
+		typedef ctype T;                                   \
+		T* p = (T*)(a)->data;                              \
+		for (GLsizei i = 0; i < (a)->count; ++i) {         \
+			__VA_ARGS__;                                   \
+		}                                                  \
+	} break;
+
+#define ARRAY_FOREACH(a, ...)                                          \
+	switch ((a)->element_type)                                         \
+	{                                                                  \
+		_ARRAY_CASE(GL_BYTE,           GLbyte,   a, __VA_ARGS__)      \
+		_ARRAY_CASE(GL_UNSIGNED_BYTE,  GLubyte,  a, __VA_ARGS__)      \
+		_ARRAY_CASE(GL_SHORT,          GLshort,  a, __VA_ARGS__)      \
+		_ARRAY_CASE(GL_UNSIGNED_SHORT, GLushort, a, __VA_ARGS__)      \
+		_ARRAY_CASE(GL_INT,            GLint,    a, __VA_ARGS__)      \
+		_ARRAY_CASE(GL_UNSIGNED_INT,   GLuint,   a, __VA_ARGS__)      \
+		_ARRAY_CASE(GL_FLOAT,          GLfloat,  a, __VA_ARGS__)      \
+		_ARRAY_CASE(GL_DOUBLE,         GLdouble, a, __VA_ARGS__)      \
+	}
+
+GLsizei array_type_size(GLenum type)
+{
+	switch (type)
+	{
+	case GL_BYTE:           return sizeof(GLbyte);
+	case GL_UNSIGNED_BYTE:  return sizeof(GLubyte);
+	case GL_SHORT:          return sizeof(GLshort);
+	case GL_UNSIGNED_SHORT: return sizeof(GLushort);
+	case GL_INT:            return sizeof(GLint);
+	case GL_UNSIGNED_INT:   return sizeof(GLuint);
+	case GL_FLOAT:          return sizeof(GLfloat);
+	case GL_DOUBLE:         return sizeof(GLdouble);
+	}
+	return 0;
+}
+
+lua_Number array_get(const array* a, GLsizei i)
+{
+	switch (a->element_type)
+	{
+	case GL_BYTE:           return ((GLbyte*)a->data)[i];
+	case GL_UNSIGNED_BYTE:  return ((GLubyte*)a->data)[i];
+	case GL_SHORT:          return ((GLshort*)a->data)[i];
+	case GL_UNSIGNED_SHORT: return ((GLushort*)a->data)[i];
+	case GL_INT:            return ((GLint*)a->data)[i];
+	case GL_UNSIGNED_INT:   return ((GLuint*)a->data)[i];
+	case GL_FLOAT:          return ((GLfloat*)a->data)[i];
+	case GL_DOUBLE:         return ((GLdouble*)a->data)[i];
+	}
+	return 0;
+}
+
+void array_set(array* a, GLsizei i, lua_Number v)
+{
+	switch (a->element_type)
+	{
+	case GL_BYTE:           ((GLbyte*)a->data)[i]   = (GLbyte)v;   break;
+	case GL_UNSIGNED_BYTE:  ((GLubyte*)a->data)[i]  = (GLubyte)v;  break;
+	case GL_SHORT:          ((GLshort*)a->data)[i]  = (GLshort)v;  break;
+	case GL_UNSIGNED_SHORT: ((GLushort*)a->data)[i] = (GLushort)v; break;
+	case GL_INT:            ((GLint*)a->data)[i]    = (GLint)v;    break;
+	case GL_UNSIGNED_INT:   ((GLuint*)a->data)[i]   = (GLuint)v;   break;
+	case GL_FLOAT:          ((GLfloat*)a->data)[i]  = (GLfloat)v;  break;
+	case GL_DOUBLE:         ((GLdouble*)a->data)[i] = (GLdouble)v; break;
+	}
+}
+
+array* l_checkarray(lua_State* L, int idx)
+{
+	return (array*)luaL_checkudata(L, idx, INTERNAL_NAME);
+}
+
+int l_isarray(lua_State* L, int idx)
+{
+	if (NULL == lua_touserdata(L, idx))
+		return 0;
+
+	luaL_getmetatable(L, INTERNAL_NAME);
+	lua_getmetatable(L, idx);
+	int equal = lua_rawequal(L, -1, -2);
+	lua_pop(L, 2);
+
+	return equal;
+}
+
+// checks that `idx' is an array of the same type and length as `a'
+static array* check_operand(lua_State* L, array* a, int idx)
+{
+	array* x = l_checkarray(L, idx);
+	if (x->element_type != a->element_type)
+		luaL_error(L, "Array types do not match");
+	if (x->count != a->count)
+		luaL_error(L, "Array lengths do not match: %d vs. %d", a->count, x->count);
+	return x;
+}
+
+// translates lua index (1-based, negative counts from the end) to C index
+static GLsizei check_index(lua_State* L, array* a, int idx, int def)
+{
+	int i = luaL_optinteger(L, idx, def);
+	if (i < 0)
+		i += a->count + 1;
+	if (i < 1 || i > a->count)
+		luaL_error(L, "Index out of range: %d", i);
+	return i - 1;
+}
+
+static int l_array___index(lua_State* L)
+{
+	if (lua_isnumber(L, 2))
+	{
+		array* a = (array*)lua_touserdata(L, 1);
+		GLsizei i = check_index(L, a, 2, 0);
+		lua_pushnumber(L, array_get(a, i));
+		return 1;
+	}
+
+	luaL_getmetatable(L, INTERNAL_NAME);
+	lua_pushvalue(L, 2);
+	lua_rawget(L, -2);
+	if (!lua_isnoneornil(L, -1))
+		return 1;
+
+	array* a = (array*)lua_touserdata(L, 1);
+	const char* key = luaL_checkstring(L, 2);
+	if (0 == strcmp(key, "type"))
+		lua_pushinteger(L, a->element_type);
+	else
+		lua_pushnil(L);
+	return 1;
+}
+
+static int l_array___newindex(lua_State* L)
+{
+	array* a = (array*)lua_touserdata(L, 1);
+	if (!lua_isnumber(L, 2))
+		return luaL_error(L, "Cannot set property `%s'", luaL_checkstring(L, 2));
+
+	GLsizei i = check_index(L, a, 2, 0);
+	array_set(a, i, luaL_checknumber(L, 3));
+	return 0;
+}
+
+static int l_array___len(lua_State* L)
+{
+	array* a = (array*)lua_touserdata(L, 1);
+	lua_pushinteger(L, a->count);
+	return 1;
+}
+
+static int l_array_fill(lua_State* L)
+{
+	array* a = l_checkarray(L, 1);
+	lua_Number v = luaL_checknumber(L, 2);
+	if (0 == a->count)
+	{
+		lua_settop(L, 1);
+		return 1;
+	}
+
+	GLsizei low  = check_index(L, a, 3, 1);
+	GLsizei high = check_index(L, a, 4, a->count);
+	for (GLsizei i = low; i <= high; ++i)
+		array_set(a, i, v);
+
+	lua_settop(L, 1);
+	return 1;
+}
+
+static int l_array_slice(lua_State* L)
+{
+	array* a = l_checkarray(L, 1);
+	if (0 == a->count)
+	{
+		l_array_push(L, a->element_type, 0);
+		return 1;
+	}
+
+	GLsizei low  = check_index(L, a, 2, 1);
+	GLsizei high = check_index(L, a, 3, a->count);
+	GLsizei count = high >= low ? high - low + 1 : 0;
+
+	array* s = l_array_push(L, a->element_type, count);
+	memcpy(s->data, (char*)a->data + low * a->element_size, count * a->element_size);
+	return 1;
+}
+
+// a[i] = alpha * x[i] + a[i]
+static int l_array_axpy(lua_State* L)
+{
+	array* a = l_checkarray(L, 1);
+	lua_Number alpha = luaL_checknumber(L, 2);
+	array* x = check_operand(L, a, 3);
+
+	ARRAY_FOREACH(a, p[i] = (T)(alpha * ((T*)x->data)[i] + p[i]));
+
+	lua_settop(L, 1);
+	return 1;
+}
+
+static int l_array_scale(lua_State* L)
+{
+	array* a = l_checkarray(L, 1);
+	lua_Number alpha = luaL_checknumber(L, 2);
+
+	ARRAY_FOREACH(a, p[i] = (T)(alpha * p[i]));
+
+	lua_settop(L, 1);
+	return 1;
+}
+
+// elementwise minimum with a number or another array
+static int l_array_min(lua_State* L)
+{
+	array* a = l_checkarray(L, 1);
+	if (lua_isnumber(L, 2))
+	{
+		lua_Number v = lua_tonumber(L, 2);
+		ARRAY_FOREACH(a, if (v < p[i]) p[i] = (T)v);
+	}
+	else
+	{
+		array* x = check_operand(L, a, 2);
+		ARRAY_FOREACH(a, T v = ((T*)x->data)[i]; if (v < p[i]) p[i] = v);
+	}
+
+	lua_settop(L, 1);
+	return 1;
+}
+
+// elementwise maximum with a number or another array
+static int l_array_max(lua_State* L)
+{
+	array* a = l_checkarray(L, 1);
+	if (lua_isnumber(L, 2))
+	{
+		lua_Number v = lua_tonumber(L, 2);
+		ARRAY_FOREACH(a, if (v > p[i]) p[i] = (T)v);
+	}
+	else
+	{
+		array* x = check_operand(L, a, 2);
+		ARRAY_FOREACH(a, T v = ((T*)x->data)[i]; if (v > p[i]) p[i] = v);
+	}
+
+	lua_settop(L, 1);
+	return 1;
+}
+
+static int l_array_clamp(lua_State* L)
+{
+	array* a = l_checkarray(L, 1);
+	lua_Number low  = luaL_checknumber(L, 2);
+	lua_Number high = luaL_checknumber(L, 3);
+	if (low > high)
+		return luaL_error(L, "Invalid range: [%f:%f]", low, high);
+
+	ARRAY_FOREACH(a,
+		if (p[i] < low) p[i] = (T)low;
+		else if (p[i] > high) p[i] = (T)high);
+
+	lua_settop(L, 1);
+	return 1;
+}
+
+array* l_array_push(lua_State* L, GLenum type, GLsizei count)
+{
+	GLsizei element_size = array_type_size(type);
+	if (0 == element_size)
+		luaL_error(L, "Invalid data type");
+	if (count < 0)
+		luaL_error(L, "Invalid array size: %d", count);
+
+	// elements are stored right behind the header
+	array* a = (array*)lua_newuserdata(L, sizeof(array) + count * element_size);
+	if (NULL == a)
+		luaL_error(L, "Out of memory");
+
+	a->element_type = type;
+	a->element_size = element_size;
+	a->count = count;
+	a->data = (void*)(a + 1);
+	memset(a->data, 0, count * element_size);
+
+	if (luaL_newmetatable(L, INTERNAL_NAME))
+	{
+		luaL_reg meta[] =
+		{
+			{"__index",    l_array___index},
+			{"__newindex", l_array___newindex},
+			{"__len",      l_array___len},
+			{"fill",       l_array_fill},
+			{"slice",      l_array_slice},
+			{"axpy",       l_array_axpy},
+			{"scale",      l_array_scale},
+			{"min",        l_array_min},
+			{"max",        l_array_max},
+			{"clamp",      l_array_clamp},
+			{NULL, NULL}
+		};
+		l_registerFunctions(L, -1, meta);
+	}
+	lua_setmetatable(L, -2);
+
+	return a;
+}
+
+int l_array_new(lua_State* L)
+{
+	GLenum type = luaL_checkinteger(L, 1);
+
+	if (lua_istable(L, 2))
+	{
+		int count = lua_objlen(L, 2);
+		array* a = l_array_push(L, type, count);
+		for (int i = 0; i < count; ++i)
+		{
+			lua_rawgeti(L, 2, i+1);
+			array_set(a, i, lua_tonumber(L, -1));
+			lua_pop(L, 1);
+		}
+		return 1;
+	}
+
+	l_array_push(L, type, luaL_checkinteger(L, 2));
+	return 1;
+}
@@ -0,0 +1,24 @@
+#ifndef __G4L_ARRAY_H
+#define __G4L_ARRAY_H
+
+#include <glew.h>
+#include <lua.h>
+
+typedef struct array
+{
+	GLenum  element_type;
+	GLsizei element_size;
+	GLsizei count;
+	void*   data;
+} array;
+
+GLsizei array_type_size(GLenum type);
+lua_Number array_get(const array* a, GLsizei i);
+void array_set(array* a, GLsizei i, lua_Number v);
+
+array* l_checkarray(lua_State* L, int idx);
+int l_isarray(lua_State* L, int idx);
+array* l_array_push(lua_State* L, GLenum type, GLsizei count);
+int l_array_new(lua_State* L);
+
+#endif
@@ -0,0 +1,284 @@
+#include "atlas.h"
+#include "helper.h"
+#include "image.h"
+#include "texture.h"
+
+#include <lua.h>
+#include <lauxlib.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* INTERNAL_NAME = "G4L.atlas";
+
+atlas* l_checkatlas(lua_State* L, int idx)
+{
+	return (atlas*)luaL_checkudata(L, idx, INTERNAL_NAME);
+}
+
+// returns lowest y where a rectangle of width `w' can be placed at the
+// left edge of node `i', or -1 if it would cross the right border
+static int skyline_fit(const skyline* s, int i, int w, int page_width)
+{
+	if (s->nodes[i].x + w > page_width)
+		return -1;
+
+	int y = 0;
+	for (int left = w; left > 0; ++i)
+	{
+		if (s->nodes[i].y > y)
+			y = s->nodes[i].y;
+		left -= s->nodes[i].width;
+	}
+	return y;
+}
+
+// bottom-left heuristic: returns the node where the rectangle ends up
+// lowest, or -1 if it does not fit on this page
+static int skyline_find(const skyline* s, int w, int h, int page_width, int page_height, int* y)
+{
+	int best = -1, best_top = page_height + 1, best_width = 0;
+	for (int i = 0; i < s->count; ++i)
+	{
+		int fit = skyline_fit(s, i, w, page_width);
+		if (fit < 0 || fit + h > page_height)
+			continue;
+
+		int top = fit + h;
+		if (top < best_top || (top == best_top && s->nodes[i].width < best_width))
+		{
+			best = i;
+			best_top = top;
+			best_width = s->nodes[i].width;
+			*y = fit;
+		}
+	}
+	return best;
+}
+
+// raises the skyline to `top' between x and x+w, starting at node `i'
+static void skyline_insert(lua_State* L, skyline* s, int i, int top, int w)
+{
+	if (s->count == s->capacity)
+	{
+		int capacity = s->capacity * 2;
+		skylinenode* nodes = (skylinenode*)realloc(s->nodes, capacity * sizeof(skylinenode));
+		if (NULL == nodes)
+			luaL_error(L, "Out of memory");
+		s->nodes = nodes;
+		s->capacity = capacity;
+	}
+
+	int x = s->nodes[i].x;
+	memmove(&s->nodes[i+1], &s->nodes[i], (s->count - i) * sizeof(skylinenode));
+	s->nodes[i].x = x;
+	s->nodes[i].y = top;
+	s->nodes[i].width = w;
+	++s->count;
+
+	// cut away what is covered by the new node
+	int end = x + w;
+	int k = i + 1;
+	while (k < s->count && s->nodes[k].x < end)
+	{
+		int covered = end - s->nodes[k].x;
+		if (covered < s->nodes[k].width)
+		{
+			s->nodes[k].x += covered;
+			s->nodes[k].width -= covered;
+			break;
+		}
+		memmove(&s->nodes[k], &s->nodes[k+1], (s->count - k - 1) * sizeof(skylinenode));
+		--s->count;
+	}
+
+	// merge neighbours of equal height
+	for (k = 0; k + 1 < s->count;)
+	{
+		if (s->nodes[k].y != s->nodes[k+1].y)
+		{
+			++k;
+			continue;
+		}
+		s->nodes[k].width += s->nodes[k+1].width;
+		memmove(&s->nodes[k+1], &s->nodes[k+2], (s->count - k - 2) * sizeof(skylinenode));
+		--s->count;
+	}
+}
+
+// adds an empty page and a cleared texture for it
+static void add_page(lua_State* L, atlas* a)
+{
+	skyline* pages = (skyline*)realloc(a->pages, (a->page_count + 1) * sizeof(skyline));
+	if (NULL == pages)
+		luaL_error(L, "Out of memory");
+	a->pages = pages;
+
+	skyline* s = &a->pages[a->page_count];
+	s->nodes = (skylinenode*)malloc(16 * sizeof(skylinenode));
+	if (NULL == s->nodes)
+		luaL_error(L, "Out of memory");
+	s->nodes[0].x = 0;
+	s->nodes[0].y = 0;
+	s->nodes[0].width = a->width;
+	s->count = 1;
+	s->capacity = 16;
+	++a->page_count;
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, a->textures_ref);
+	lua_pushcfunction(L, l_texture_new);
+	lua_pushinteger(L, a->width);
+	lua_pushinteger(L, a->height);
+	lua_pushinteger(L, a->unit);
+	for (int i = 0; i < 4; ++i)
+		lua_pushnil(L);
+	lua_pushinteger(L, a->format);
+	lua_call(L, 8, 1);
+	texture* tex = l_checktexture(L, -1);
+	lua_rawseti(L, -2, a->page_count);
+	lua_pop(L, 1);
+
+	// padding between the images must not show garbage
+	image blank = {a->width, a->height, tex->format, NULL};
+	blank.data = calloc((size_t)a->width * a->height, tex->format->size);
+	if (NULL == blank.data)
+		luaL_error(L, "Out of memory");
+	texture_update(tex, &blank, 0, 0);
+	free(blank.data);
+}
+
+// returns u0, v0, u1, v1 and the texture of the page the image was put on
+static int l_atlas_add(lua_State* L)
+{
+	atlas* a = l_checkatlas(L, 1);
+	image* img = l_checkimage(L, 2);
+
+	const pixelformat* f = image_pixelformat(a->format);
+	if (img->format->format != f->format || img->format->type != f->type)
+		return luaL_error(L, "Image format does not match atlas format");
+
+	if (0 == img->width || 0 == img->height)
+		return luaL_error(L, "Cannot add empty image");
+
+	if (img->width > a->width || img->height > a->height)
+		return luaL_error(L, "Image does not fit into atlas: %dx%d > %dx%d",
+		                  img->width, img->height, a->width, a->height);
+
+	// padding is only needed between images, not at the page border
+	int w = img->width + a->padding;
+	int h = img->height + a->padding;
+	if (w > a->width)
+		w = a->width;
+	if (h > a->height)
+		h = a->height;
+
+	int page, node = -1, y = 0;
+	for (page = 0; page < a->page_count && node < 0; ++page)
+		node = skyline_find(&a->pages[page], w, h, a->width, a->height, &y);
+
+	if (node < 0)
+	{
+		add_page(L, a);
+		page = a->page_count;
+		node = 0;
+		y = 0;
+	}
+
+	skyline* s = &a->pages[page - 1];
+	int x = s->nodes[node].x;
+	skyline_insert(L, s, node, y + h, w);
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, a->textures_ref);
+	lua_rawgeti(L, -1, page);
+	texture_update(l_checktexture(L, -1), img, x, y);
+
+	lua_pushnumber(L, (lua_Number)x / a->width);
+	lua_pushnumber(L, (lua_Number)y / a->height);
+	lua_pushnumber(L, (lua_Number)(x + img->width) / a->width);
+	lua_pushnumber(L, (lua_Number)(y + img->height) / a->height);
+	lua_pushvalue(L, -5);
+	return 5;
+}
+
+static int l_atlas___index(lua_State* L)
+{
+	lua_getmetatable(L, 1);
+	lua_pushvalue(L, 2);
+	lua_rawget(L, -2);
+	if (!lua_isnoneornil(L, -1))
+		return 1;
+
+	atlas* a = (atlas*)lua_touserdata(L, 1);
+	const char* key = luaL_checkstring(L, 2);
+
+	if (0 == strcmp(key, "pages"))
+	{
+		lua_rawgeti(L, LUA_REGISTRYINDEX, a->textures_ref);
+	}
+	else if (0 == strcmp(key, "width"))
+	{
+		lua_pushinteger(L, a->width);
+	}
+	else if (0 == strcmp(key, "height"))
+	{
+		lua_pushinteger(L, a->height);
+	}
+	else
+	{
+		lua_pushnil(L);
+	}
+
+	return 1;
+}
+
+static int l_atlas___gc(lua_State* L)
+{
+	atlas* a = (atlas*)lua_touserdata(L, 1);
+	for (int i = 0; i < a->page_count; ++i)
+		free(a->pages[i].nodes);
+	free(a->pages);
+	luaL_unref(L, LUA_REGISTRYINDEX, a->textures_ref);
+	return 0;
+}
+
+int l_atlas_new(lua_State* L)
+{
+	int width = luaL_checkinteger(L, 1);
+	int height = luaL_checkinteger(L, 2);
+	int unit = luaL_optinteger(L, 3, 1);
+	GLenum format = luaL_optinteger(L, 4, GL_RGBA8);
+	int padding = luaL_optinteger(L, 5, 1);
+
+	if (width <= 0 || height <= 0)
+		return luaL_error(L, "Invalid atlas size: %dx%d", width, height);
+	if (padding < 0)
+		return luaL_error(L, "Invalid padding: %d", padding);
+
+	atlas* a = (atlas*)lua_newuserdata(L, sizeof(atlas));
+	a->width = width;
+	a->height = height;
+	a->unit = unit;
+	a->padding = padding;
+	a->format = format;
+	a->pages = NULL;
+	a->page_count = 0;
+	lua_newtable(L);
+	a->textures_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+	if (luaL_newmetatable(L, INTERNAL_NAME))
+	{
+		luaL_reg meta[] =
+		{
+			{"__gc",    l_atlas___gc},
+			{"__index", l_atlas___index},
+			{"add",     l_atlas_add},
+
+			{NULL, NULL}
+		};
+		l_registerFunctions(L, -1, meta);
+	}
+	lua_setmetatable(L, -2);
+
+	// checks unit and format
+	add_page(L, a);
+	return 1;
+}
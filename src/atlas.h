@@ -0,0 +1,38 @@
+#ifndef __G4L_ATLAS_H
+#define __G4L_ATLAS_H
+
+#include <glew.h>
+
+struct lua_State;
+
+// top edge of the packed area between x and x+width
+typedef struct
+{
+	int x;
+	int y;
+	int width;
+} skylinenode;
+
+typedef struct
+{
+	skylinenode* nodes;
+	int          count;
+	int          capacity;
+} skyline;
+
+typedef struct
+{
+	int      width;
+	int      height;
+	int      unit;
+	int      padding;
+	GLenum   format;
+	skyline* pages;
+	int      page_count;
+	int      textures_ref; // table of one texture per page
+} atlas;
+
+atlas* l_checkatlas(struct lua_State* L, int idx);
+int l_atlas_new(struct lua_State* L);
+
+#endif
@@ -1,5 +1,7 @@
 #include "bufferobject.h"
 #include "helper.h"
+#include "shader.h"
+#include "array.h"
 
 #include <lua.h>
 #include <lauxlib.h>
@@ -11,22 +13,19 @@
 
 static const char* INTERNAL_NAME = "G4L.bufferobject";
 
-static void fill_buffer_with_table(lua_State* L, bufferobject* b, int idx, int offset)
+// converts table at `idx' to a block of b->element_type. the block is a
+// userdata left on the stack, so it is not leaked when uploading fails.
+static void* data_from_table(lua_State* L, bufferobject* b, int idx, int count)
 {
-	int count = lua_objlen(L, idx);
-	void* data = NULL;
+	void* data = lua_newuserdata(L, count * b->element_size);
 
 #define _FILL(type)                         \
-	b->element_size = sizeof(type);         \
-	data = malloc(count * sizeof(type));    \
-	if (NULL == data)                       \
-		luaL_error(L, "Out of memory");     \
 	for (int i = 1; i <= count; ++i) {      \
 		lua_rawgeti(L, idx, i);             \
 		lua_Number v = lua_tonumber(L, -1); \
 		((type*)data)[i-1] = (type)v;       \
-	}                                       \
-	lua_pop(L, count)
+		lua_pop(L, 1);                      \
+	}
 
 	switch (b->element_type)
 	{
@@ -59,43 +58,187 @@ static void fill_buffer_with_table(lua_State* L, bufferobject* b, int idx, int o
 	};
 #undef _FILL
 
-	int size_old = b->count * b->element_size;
-	int size_new = count * b->element_size;
-	offset = b->element_size;
+	return data;
+}
 
-	glBindBuffer(b->target, b->id);
-	if (size_old >= size_new + offset)
+static GLsizei grow_capacity(GLsizei capacity, GLsizei needed)
+{
+	return (capacity * 2 >= needed) ? capacity * 2 : needed;
+}
+
+static int is_orphanable(GLenum usage)
+{
+	switch (usage)
 	{
-		// reuse old buffer
-		glBufferSubData(b->target, offset, size_new, data);
+	case GL_STREAM_DRAW:
+	case GL_STREAM_READ:
+	case GL_STREAM_COPY:
+	case GL_DYNAMIC_DRAW:
+	case GL_DYNAMIC_READ:
+	case GL_DYNAMIC_COPY:
+		return 1;
 	}
-	else if (b->count == 0)
+	return 0;
+}
+
+// moves buffer contents to new storage of `capacity' elements. the old
+// contents are copied on the GPU and never read back.
+void bufferobject_reserve(bufferobject* b, GLsizei capacity)
+{
+	if (capacity <= b->capacity)
+		return;
+
+	GLuint id;
+	glGenBuffers(1, &id);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+	glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)capacity * b->element_size, NULL, b->usage);
+
+	if (b->count > 0)
 	{
-		// this is a new buffer
-		glBufferData(b->target, size_new, data, b->usage);
-		b->count = count;
+		glBindBuffer(GL_COPY_READ_BUFFER, b->id);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+		                    (GLsizeiptr)b->count * b->element_size);
 	}
-	else
+
+	glDeleteBuffers(1, &b->id);
+	b->id = id;
+	b->capacity = capacity;
+}
+
+// writes `count' elements at element `offset'. offset < 0 replaces the
+// whole contents.
+static void upload_data(bufferobject* b, const void* data, int count, int offset)
+{
+	GLsizeiptr size = (GLsizeiptr)count * b->element_size;
+
+	if (offset < 0)
 	{
-		// new data extends buffer. bollux.
-		void* new_data = malloc(size_new + offset);
-		if (NULL == new_data)
+		// old contents are discarded anyway, so there is no need to copy
+		// them on growth. stream and dynamic buffers are orphaned to avoid
+		// waiting for draw calls that still use the old storage.
+		glBindBuffer(b->target, b->id);
+		if (count > b->capacity || (count > 0 && is_orphanable(b->usage)))
 		{
-			free(data);
-			luaL_error(L, "Out of memory");
+			if (count > b->capacity)
+				b->capacity = grow_capacity(b->capacity, count);
+			glBufferData(b->target, (GLsizeiptr)b->capacity * b->element_size, NULL, b->usage);
 		}
+		if (size > 0)
+			glBufferSubData(b->target, 0, size, data);
+		b->count = count;
+		return;
+	}
 
-		// merge unchanged with new part
-		void* old_data = NULL;
-		glGetBufferSubData(b->target, 0, offset, old_data);
-		memcpy(new_data, old_data, offset);
-		memcpy((void*)((char*)new_data + offset), data, size_new);
+	GLsizei end = offset + count;
+	if (end > b->capacity)
+		bufferobject_reserve(b, grow_capacity(b->capacity, end));
 
-		glBufferData(b->target, size_new + offset, new_data, b->usage);
-		free(new_data);
-		b->count = count;
+	glBindBuffer(b->target, b->id);
+	glBufferSubData(b->target, (GLintptr)offset * b->element_size, size, data);
+	if (end > b->count)
+		b->count = end;
+}
+
+// waits until the GPU is done with a streaming region
+static void wait_region(bufferobject* b, int region)
+{
+	GLsync fence = b->fences[region];
+	if (NULL == fence)
+		return;
+
+	GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	while (GL_TIMEOUT_EXPIRED == status)
+		status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+
+	glDeleteSync(fence);
+	b->fences[region] = NULL;
+}
+
+// writes data to the next region of a streaming buffer. the region is
+// written unsynchronized, so the upload never waits for draw calls of the
+// other regions.
+static void stream_data(lua_State* L, bufferobject* b, const void* data, int count, int offset)
+{
+	GLsizeiptr size = (GLsizeiptr)count * b->element_size;
+	if (offset >= 0)
+		luaL_error(L, "Streaming buffers cannot be updated at an offset");
+	if (size > b->region_size)
+		luaL_error(L, "Data exceeds region size: %d > %d elements",
+		           count, (int)(b->region_size / b->element_size));
+
+	// draw calls on the current region are issued: fence it and move on
+	b->fences[b->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	b->region = (b->region + 1) % b->regions;
+	wait_region(b, b->region);
+
+	b->offset = b->region * b->region_size;
+	b->count = count;
+	if (0 == size)
+		return;
+
+	glBindBuffer(b->target, b->id);
+	void* mapped = glMapBufferRange(b->target, b->offset, size,
+	                                GL_MAP_WRITE_BIT |
+	                                GL_MAP_UNSYNCHRONIZED_BIT |
+	                                GL_MAP_INVALIDATE_RANGE_BIT);
+	if (NULL == mapped)
+		luaL_error(L, "Cannot map buffer");
+
+	memcpy(mapped, data, size);
+	if (GL_FALSE == glUnmapBuffer(b->target))
+		luaL_error(L, "Buffer contents corrupted. Please update again.");
+}
+
+static void write_data(lua_State* L, bufferobject* b, const void* data, int count, int offset)
+{
+	if (b->regions > 0)
+		stream_data(L, b, data, count, offset);
+	else
+		upload_data(b, data, count, offset);
+}
+
+int l_isbufferdata(lua_State* L, int idx)
+{
+	return lua_istable(L, idx) || LUA_TSTRING == lua_type(L, idx) || l_isarray(L, idx);
+}
+
+int bufferobject_data_count(lua_State* L, bufferobject* b, int idx)
+{
+	if (l_isarray(L, idx))
+		return ((array*)lua_touserdata(L, idx))->count;
+	if (LUA_TSTRING == lua_type(L, idx))
+		return lua_objlen(L, idx) / b->element_size;
+	return lua_objlen(L, idx);
+}
+
+// fills buffer from either a table of numbers, a string of packed elements
+// or an array. strings and arrays are handed to GL without conversion.
+void bufferobject_fill(lua_State* L, bufferobject* b, int idx, int offset)
+{
+	if (l_isarray(L, idx))
+	{
+		array* a = (array*)lua_touserdata(L, idx);
+		if (a->element_type != b->element_type)
+			luaL_error(L, "Array type does not match buffer element type");
+		write_data(L, b, a->data, a->count, offset);
+		return;
+	}
+
+	if (LUA_TSTRING == lua_type(L, idx))
+	{
+		size_t len;
+		const char* data = lua_tolstring(L, idx, &len);
+		if (len % b->element_size != 0)
+			luaL_error(L, "Data size (%d bytes) is not a multiple of the element size (%d bytes)",
+			           (int)len, (int)b->element_size);
+		write_data(L, b, data, len / b->element_size, offset);
+		return;
 	}
-	free(data);
+
+	int count = lua_objlen(L, idx);
+	void* data = data_from_table(L, b, idx, count);
+	write_data(L, b, data, count, offset);
+	lua_pop(L, 1);
 }
 
 bufferobject* l_checkbufferobject(lua_State* L, int idx)
@@ -106,24 +249,96 @@ bufferobject* l_checkbufferobject(lua_State* L, int idx)
 static int l_bufferobject___gc(lua_State* L)
 {
 	bufferobject* b = (bufferobject*)lua_touserdata(L, 1);
+	for (int i = 0; i < b->regions; ++i)
+	{
+		if (NULL != b->fences[i])
+			glDeleteSync(b->fences[i]);
+	}
 	glDeleteBuffers(1, &(b->id));
 	return 0;
 }
 
+// number of vertices (array buffers) or indices that can be drawn
+static GLsizei draw_count(bufferobject* b)
+{
+	if (GL_ARRAY_BUFFER == b->target)
+		return b->count / b->stride;
+	return b->count;
+}
+
+// reads optional [first, count] at `idx'. first is 1-based in Lua.
+static void check_range(lua_State* L, bufferobject* b, int idx, GLint* first, GLsizei* count)
+{
+	*first = luaL_optinteger(L, idx, 1) - 1;
+	*count = luaL_optinteger(L, idx+1, draw_count(b) - *first);
+	if (*first < 0 || *count < 0 || *first + *count > draw_count(b))
+		luaL_error(L, "Invalid range: %d elements from %d", *count, *first + 1);
+}
+
+static void* index_pointer(bufferobject* b, GLint first)
+{
+	return (GLvoid*)((char*)NULL + b->offset + first * b->element_size);
+}
+
 int l_bufferobject_draw(lua_State* L)
 {
 	bufferobject* b = l_checkbufferobject(L, 1);
 	GLenum mode = luaL_checkinteger(L, 2);
+	GLint first;
+	GLsizei count;
+	check_range(L, b, 3, &first, &count);
+	GLint basevertex = luaL_optinteger(L, 5, 0);
+
+	shader_bind_active();
+	glBindBuffer(b->target, b->id);
+	glGetError();
+	switch (b->target)
+	{
+	case GL_ARRAY_BUFFER:
+		glDrawArrays(mode, first, count);
+		break;
+	case GL_ELEMENT_ARRAY_BUFFER:
+		if (0 != basevertex)
+		{
+			assert_extension(L, ARB_draw_elements_base_vertex);
+			glDrawElementsBaseVertex(mode, count, b->element_type, index_pointer(b, first), basevertex);
+		}
+		else
+		{
+			glDrawElements(mode, count, b->element_type, index_pointer(b, first));
+		}
+		break;
+	default:
+		return luaL_error(L, "Not implemented");
+	}
+	if (GL_INVALID_ENUM == glGetError())
+		return luaL_error(L, "Invalid draw mode");
+	return 0;
+}
+
+static int l_bufferobject_drawInstanced(lua_State* L)
+{
+	bufferobject* b = l_checkbufferobject(L, 1);
+	GLenum mode = luaL_checkinteger(L, 2);
+	GLsizei instances = luaL_checkinteger(L, 3);
+	GLint first;
+	GLsizei count;
+	check_range(L, b, 4, &first, &count);
 
+	assert_extension(L, ARB_draw_instanced);
+	if (instances < 0)
+		return luaL_error(L, "Invalid number of instances: %d", instances);
+
+	shader_bind_active();
 	glBindBuffer(b->target, b->id);
 	glGetError();
 	switch (b->target)
 	{
 	case GL_ARRAY_BUFFER:
-		glDrawArrays(mode, 0, b->count);
+		glDrawArraysInstanced(mode, first, count, instances);
 		break;
 	case GL_ELEMENT_ARRAY_BUFFER:
-		glDrawElements(mode, b->count, b->element_type, NULL);
+		glDrawElementsInstanced(mode, count, b->element_type, index_pointer(b, first), instances);
 		break;
 	default:
 		return luaL_error(L, "Not implemented");
@@ -133,19 +348,120 @@ int l_bufferobject_draw(lua_State* L)
 	return 0;
 }
 
+// reads a table or int array at `idx' into a block of `n' ints. the block
+// is pushed as userdata, so it is collected even if an error is raised.
+static GLint* to_int_list(lua_State* L, int idx, int n)
+{
+	GLint* list = (GLint*)lua_newuserdata(L, n * sizeof(GLint));
+
+	if (l_isarray(L, idx))
+	{
+		array* a = (array*)lua_touserdata(L, idx);
+		for (int i = 0; i < n; ++i)
+			list[i] = (GLint)array_get(a, i);
+		return list;
+	}
+
+	for (int i = 0; i < n; ++i)
+	{
+		lua_rawgeti(L, idx, i+1);
+		list[i] = lua_tointeger(L, -1);
+		lua_pop(L, 1);
+	}
+	return list;
+}
+
+static int list_length(lua_State* L, int idx)
+{
+	if (l_isarray(L, idx))
+		return ((array*)lua_touserdata(L, idx))->count;
+	if (!lua_istable(L, idx))
+		return luaL_typerror(L, idx, "table or array");
+	return lua_objlen(L, idx);
+}
+
+static int l_bufferobject_multiDraw(lua_State* L)
+{
+	bufferobject* b = l_checkbufferobject(L, 1);
+	GLenum mode = luaL_checkinteger(L, 2);
+	int n = list_length(L, 3);
+	if (list_length(L, 4) != n)
+		return luaL_error(L, "Number of firsts and counts do not match");
+
+	int has_basevertex = !lua_isnoneornil(L, 5);
+	if (has_basevertex && GL_ELEMENT_ARRAY_BUFFER != b->target)
+		return luaL_error(L, "Base vertices need an element array buffer");
+	if (has_basevertex && list_length(L, 5) != n)
+		return luaL_error(L, "Number of firsts and base vertices do not match");
+	if (GL_ARRAY_BUFFER != b->target && GL_ELEMENT_ARRAY_BUFFER != b->target)
+		return luaL_error(L, "Not implemented");
+	if (has_basevertex)
+		assert_extension(L, ARB_draw_elements_base_vertex);
+
+	GLint* firsts = to_int_list(L, 3, n);
+	GLint* counts = to_int_list(L, 4, n);
+	GLsizei available = draw_count(b);
+	for (int i = 0; i < n; ++i)
+	{
+		firsts[i] -= 1;
+		if (firsts[i] < 0 || counts[i] < 0 || firsts[i] + counts[i] > available)
+			return luaL_error(L, "Invalid range #%d: %d elements from %d",
+			                  i+1, counts[i], firsts[i]+1);
+	}
+
+	shader_bind_active();
+	glBindBuffer(b->target, b->id);
+	glGetError();
+	if (GL_ARRAY_BUFFER == b->target)
+	{
+		glMultiDrawArrays(mode, firsts, counts, n);
+	}
+	else
+	{
+		const GLvoid** indices = (const GLvoid**)lua_newuserdata(L, n * sizeof(GLvoid*));
+		for (int i = 0; i < n; ++i)
+			indices[i] = index_pointer(b, firsts[i]);
+
+		if (has_basevertex)
+		{
+			GLint* basevertices = to_int_list(L, 5, n);
+			glMultiDrawElementsBaseVertex(mode, counts, b->element_type, indices, n, basevertices);
+		}
+		else
+		{
+			glMultiDrawElements(mode, counts, b->element_type, indices, n);
+		}
+	}
+
+	if (GL_INVALID_ENUM == glGetError())
+		return luaL_error(L, "Invalid draw mode");
+	return 0;
+}
+
 static int l_bufferobject_update(lua_State* L)
 {
 	bufferobject* b = l_checkbufferobject(L, 1);
 	int top = lua_gettop(L);
-	int offset = 0;
+	int offset = -1;
 
 	if (top > 2)
+	{
 		offset = luaL_checkinteger(L, 2) - 1;
+		if (offset < 0 || offset > b->count)
+			return luaL_error(L, "Offset out of range: %d", offset + 1);
+	}
+	else if (b->pooled)
+	{
+		return luaL_error(L, "Cannot replace contents of a pooled buffer. Use pool:update().");
+	}
+
+	if (!l_isbufferdata(L, top))
+		return luaL_typerror(L, top, "table, string or array");
 
 	while (GL_NO_ERROR != glGetError())
 		/*clear error flags*/;
 
-	fill_buffer_with_table(L, b, top, offset);
+	bufferobject_fill(L, b, top, offset);
 
 	if (GL_NO_ERROR != glGetError())
 		return luaL_error(L, "Unable to create data storage");
@@ -154,28 +470,69 @@ static int l_bufferobject_update(lua_State* L)
 	return 1;
 }
 
-int l_bufferobject_new(lua_State* L)
+static int l_bufferobject_reserve(lua_State* L)
 {
-	if (!context_available())
-		return luaL_error(L, "No OpenGL context available. Create a window first.");
+	bufferobject* b = l_checkbufferobject(L, 1);
+	int capacity = luaL_checkinteger(L, 2);
+	if (b->regions > 0)
+		return luaL_error(L, "Cannot resize streaming buffers");
+	if (b->pooled)
+		return luaL_error(L, "Cannot resize pooled buffers");
 
-	assert_extension(L, ARB_vertex_buffer_object);
+	while (GL_NO_ERROR != glGetError())
+		/*clear error flags*/;
 
-	GLenum target = GL_ARRAY_BUFFER;
-	GLenum usage = GL_STATIC_DRAW;
-	GLenum element_type = GL_FLOAT;
+	bufferobject_reserve(b, capacity);
 
-	int top = lua_gettop(L);
-	if (!lua_istable(L, top))
-		return luaL_typerror(L, top, "table");
+	if (GL_NO_ERROR != glGetError())
+		return luaL_error(L, "Unable to create data storage");
 
-	if (top > 1)
-		target       = luaL_checkinteger(L, 1);
-	if (top > 2)
-		usage        = luaL_checkinteger(L, 2);
-	if (top > 3)
-		element_type = luaL_checkinteger(L, 3);
+	lua_settop(L, 1);
+	return 1;
+}
+
+// discards contents. the driver hands out fresh storage instead of waiting
+// for pending draw calls on the old one.
+static int l_bufferobject_orphan(lua_State* L)
+{
+	bufferobject* b = l_checkbufferobject(L, 1);
+	if (b->regions > 0)
+		return luaL_error(L, "Cannot orphan streaming buffers");
+	if (b->pooled)
+		return luaL_error(L, "Cannot orphan pooled buffers");
+
+	glBindBuffer(b->target, b->id);
+	glBufferData(b->target, (GLsizeiptr)b->capacity * b->element_size, NULL, b->usage);
+	b->count = 0;
+
+	lua_settop(L, 1);
+	return 1;
+}
+
+static void set_metatable(lua_State* L)
+{
+	if (luaL_newmetatable(L, INTERNAL_NAME))
+	{
+		luaL_reg meta[] =
+		{
+			{"__gc",          l_bufferobject___gc},
+			{"update",        l_bufferobject_update},
+			{"reserve",       l_bufferobject_reserve},
+			{"orphan",        l_bufferobject_orphan},
+			{"draw",          l_bufferobject_draw},
+			{"drawInstanced", l_bufferobject_drawInstanced},
+			{"multiDraw",     l_bufferobject_multiDraw},
+			{NULL, NULL}
+		};
+		l_registerFunctions(L, -1, meta);
+		lua_pushvalue(L, -1);
+		lua_setfield(L, -1, "__index");
+	}
+	lua_setmetatable(L, -2);
+}
 
+bufferobject* l_bufferobject_push(lua_State* L, GLenum target, GLenum usage, GLenum element_type)
+{
 	switch (target)
 	{
 	case GL_ARRAY_BUFFER:
@@ -189,7 +546,7 @@ int l_bufferobject_new(lua_State* L)
 	case GL_UNIFORM_BUFFER:
 		break;
 	default:
-		return luaL_error(L, "Invalid buffer target");
+		luaL_error(L, "Invalid buffer target");
 	}
 
 	switch (usage)
@@ -205,12 +562,16 @@ int l_bufferobject_new(lua_State* L)
 	case GL_DYNAMIC_COPY:
 		break;
 	default:
-		return luaL_error(L, "Invalid buffer usage");
+		luaL_error(L, "Invalid buffer usage");
 	}
 
+	GLsizei element_size = array_type_size(element_type);
+	if (0 == element_size)
+		luaL_error(L, "Invalid data type");
+
 	bufferobject* b = (bufferobject*)lua_newuserdata(L, sizeof(bufferobject));
 	if (NULL == b)
-		return luaL_error(L, "Out of memory");
+		luaL_error(L, "Out of memory");
 
 	GLuint id;
 	glGenBuffers(1, &id);
@@ -219,33 +580,126 @@ int l_bufferobject_new(lua_State* L)
 	b->target = target;
 	b->usage = usage;
 	b->count = 0;
+	b->capacity = 0;
 	b->element_type = element_type;
+	b->element_size = element_size;
+	b->stride = 1;
+	b->pooled = 0;
+	b->offset = 0;
+	b->regions = 0;
+	b->region = 0;
+	b->region_size = 0;
+	b->fences = NULL;
+
+	set_metatable(L);
+	return b;
+}
+
+int l_bufferobject_new(lua_State* L)
+{
+	if (!context_available())
+		return luaL_error(L, "No OpenGL context available. Create a window first.");
+
+	assert_extension(L, ARB_vertex_buffer_object);
+
+	GLenum target = GL_ARRAY_BUFFER;
+	GLenum usage = GL_STATIC_DRAW;
+	GLenum element_type = GL_FLOAT;
+
+	int top = lua_gettop(L);
+	if (!l_isbufferdata(L, top))
+		return luaL_typerror(L, top, "table, string or array");
+
+	if (top > 1)
+		target       = luaL_checkinteger(L, 1);
+	if (top > 2)
+		usage        = luaL_checkinteger(L, 2);
+	if (top > 3)
+		element_type = luaL_checkinteger(L, 3);
+	else if (l_isarray(L, top))
+		element_type = ((array*)lua_touserdata(L, top))->element_type;
+
+	bufferobject* b = l_bufferobject_push(L, target, usage, element_type);
 
 	while (GL_NO_ERROR != glGetError())
 		/*clear error flags*/;
 
-	fill_buffer_with_table(L, b, top, 0);
+	bufferobject_fill(L, b, top, -1);
 
 	if (GL_NO_ERROR != glGetError())
-	{
-		glDeleteBuffers(1, &(id));
 		return luaL_error(L, "Unable to create data storage");
+
+	return 1;
+}
+
+int l_bufferobject_stream(lua_State* L)
+{
+	if (!context_available())
+		return luaL_error(L, "No OpenGL context available. Create a window first.");
+
+	assert_extension(L, ARB_map_buffer_range);
+	assert_extension(L, ARB_sync);
+
+	int frame_size       = luaL_checkinteger(L, 1);
+	int regions          = luaL_optinteger(L, 2, 3);
+	GLenum target        = luaL_optinteger(L, 3, GL_ARRAY_BUFFER);
+	GLenum element_type  = luaL_optinteger(L, 4, GL_FLOAT);
+
+	if (frame_size <= 0)
+		return luaL_error(L, "Invalid frame size: %d", frame_size);
+	if (regions < 1 || regions > 16)
+		return luaL_error(L, "Invalid number of regions: %d. Need 1-16.", regions);
+
+	switch (target)
+	{
+	case GL_ARRAY_BUFFER:
+	case GL_ELEMENT_ARRAY_BUFFER:
+	case GL_TEXTURE_BUFFER:
+	case GL_UNIFORM_BUFFER:
+		break;
+	default:
+		return luaL_error(L, "Invalid buffer target");
 	}
 
-	if (luaL_newmetatable(L, INTERNAL_NAME))
+	GLsizei element_size = array_type_size(element_type);
+	if (0 == element_size)
+		return luaL_error(L, "Invalid data type");
+
+	// fences are stored right behind the buffer object
+	bufferobject* b = (bufferobject*)lua_newuserdata(L,
+			sizeof(bufferobject) + regions * sizeof(GLsync));
+	if (NULL == b)
+		return luaL_error(L, "Out of memory");
+
+	b->target       = target;
+	b->usage        = GL_STREAM_DRAW;
+	b->count        = 0;
+	b->capacity     = frame_size;
+	b->element_type = element_type;
+	b->element_size = element_size;
+	b->stride       = 1;
+	b->pooled       = 0;
+	b->offset       = 0;
+	b->regions      = regions;
+	b->region       = regions - 1;
+	b->region_size  = (GLsizeiptr)frame_size * element_size;
+	b->fences       = (GLsync*)(b + 1);
+	for (int i = 0; i < regions; ++i)
+		b->fences[i] = NULL;
+
+	while (GL_NO_ERROR != glGetError())
+		/*clear error flags*/;
+
+	glGenBuffers(1, &b->id);
+	glBindBuffer(target, b->id);
+	glBufferData(target, b->region_size * regions, NULL, GL_STREAM_DRAW);
+
+	if (GL_NO_ERROR != glGetError())
 	{
-		luaL_reg meta[] =
-		{
-			{"__gc",      l_bufferobject___gc},
-			{"update",    l_bufferobject_update},
-			{"draw",      l_bufferobject_draw},
-			{NULL, NULL}
-		};
-		l_registerFunctions(L, -1, meta);
-		lua_pushvalue(L, -1);
-		lua_setfield(L, -1, "__index");
+		glDeleteBuffers(1, &b->id);
+		return luaL_error(L, "Unable to create data storage");
 	}
-	lua_setmetatable(L, -2);
 
+	set_metatable(L);
 	return 1;
 }
@@ -11,11 +11,36 @@ typedef struct bufferobject
 	GLenum  target;
 	GLenum  usage;
 	GLsizei count;
+	GLsizei capacity;
 	GLenum  element_type;
 	GLsizei element_size;
+
+	// elements per vertex as set by the last attribute binding. draw
+	// ranges of array buffers count vertices.
+	GLsizei stride;
+
+	// owned by a buffer pool, which manages storage and contents
+	int pooled;
+
+	// byte offset of the current data. only non-zero for streaming buffers
+	GLintptr offset;
+
+	// streaming buffers: ring of `regions' regions of `region_size' bytes,
+	// each guarded by a fence. regions == 0 for ordinary buffers.
+	int        regions;
+	int        region;
+	GLsizeiptr region_size;
+	GLsync*    fences;
 } bufferobject;
 
 bufferobject* l_checkbufferobject(struct lua_State* L, int idx);
+bufferobject* l_bufferobject_push(struct lua_State* L, GLenum target, GLenum usage, GLenum element_type);
+int l_isbufferdata(struct lua_State* L, int idx);
 int l_bufferobject_new(struct lua_State* L);
+int l_bufferobject_stream(struct lua_State* L);
+
+void bufferobject_reserve(bufferobject* b, GLsizei capacity);
+void bufferobject_fill(struct lua_State* L, bufferobject* b, int idx, int offset);
+int bufferobject_data_count(struct lua_State* L, bufferobject* b, int idx);
 
 #endif
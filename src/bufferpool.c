@@ -0,0 +1,445 @@
+#include "bufferpool.h"
+#include "helper.h"
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include <glew.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char* INTERNAL_NAME = "G4L.bufferpool";
+static const char* BUFFERS_NAME  = "G4L.bufferpool.buffers";
+
+bufferpool* l_checkbufferpool(lua_State* L, int idx)
+{
+	return (bufferpool*)luaL_checkudata(L, idx, INTERNAL_NAME);
+}
+
+// grows a list of `size' byte items to hold at least `needed' items
+static void* reserve_list(lua_State* L, void* list, int* max, int needed, size_t size)
+{
+	if (needed <= *max)
+		return list;
+
+	int new_max = (*max * 2 >= needed) ? *max * 2 : needed;
+	void* new_list = realloc(list, new_max * size);
+	if (NULL == new_list)
+		luaL_error(L, "Out of memory");
+
+	*max = new_max;
+	return new_list;
+}
+
+static GLsizei align_up(GLsizei offset, GLsizei align)
+{
+	return ((offset + align - 1) / align) * align;
+}
+
+// returns range to the free list, merging it with adjacent ranges
+static void release_range(lua_State* L, bufferpool* p, GLsizei offset, GLsizei size)
+{
+	if (size <= 0)
+		return;
+
+	// binary search for first range after offset
+	int low = 0, high = p->free_count;
+	while (low < high)
+	{
+		int mid = (low + high) / 2;
+		if (p->free_ranges[mid].offset < offset)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	poolrange* prev = (low > 0) ? &(p->free_ranges[low-1]) : NULL;
+	poolrange* next = (low < p->free_count) ? &(p->free_ranges[low]) : NULL;
+	int merge_prev = (NULL != prev) && (prev->offset + prev->size == offset);
+	int merge_next = (NULL != next) && (offset + size == next->offset);
+
+	if (merge_prev && merge_next)
+	{
+		prev->size += size + next->size;
+		memmove(next, next + 1, (p->free_count - low - 1) * sizeof(poolrange));
+		--p->free_count;
+	}
+	else if (merge_prev)
+	{
+		prev->size += size;
+	}
+	else if (merge_next)
+	{
+		next->offset = offset;
+		next->size += size;
+	}
+	else
+	{
+		p->free_ranges = (poolrange*)reserve_list(L, p->free_ranges, &p->free_max,
+		                                          p->free_count + 1, sizeof(poolrange));
+		memmove(&(p->free_ranges[low+1]), &(p->free_ranges[low]),
+		        (p->free_count - low) * sizeof(poolrange));
+		p->free_ranges[low].offset = offset;
+		p->free_ranges[low].size = size;
+		++p->free_count;
+	}
+}
+
+// first fit. returns offset or -1 if no free range is large enough.
+static GLsizei take_range(lua_State* L, bufferpool* p, GLsizei size, GLsizei align)
+{
+	for (int i = 0; i < p->free_count; ++i)
+	{
+		poolrange r = p->free_ranges[i];
+		GLsizei offset = align_up(r.offset, align);
+		if (offset + size > r.offset + r.size)
+			continue;
+
+		// remove range, then hand back what is left before and after
+		memmove(&(p->free_ranges[i]), &(p->free_ranges[i+1]),
+		        (p->free_count - i - 1) * sizeof(poolrange));
+		--p->free_count;
+		release_range(L, p, r.offset, offset - r.offset);
+		release_range(L, p, offset + size, r.offset + r.size - offset - size);
+		return offset;
+	}
+	return -1;
+}
+
+static void grow_pool(lua_State* L, bufferpool* p, GLsizei needed)
+{
+	bufferobject* b = p->buffer;
+	GLsizei capacity = b->capacity * 2;
+	if (capacity < b->capacity + needed)
+		capacity = b->capacity + needed;
+
+	GLsizei old_capacity = b->capacity;
+	bufferobject_reserve(b, capacity);
+	b->count = capacity;
+	release_range(L, p, old_capacity, capacity - old_capacity);
+}
+
+static poolallocation* check_allocation(lua_State* L, bufferpool* p, int idx)
+{
+	int id = luaL_checkinteger(L, idx);
+	if (id < 1 || id > p->allocation_count || !p->allocations[id-1].used)
+		luaL_error(L, "Invalid allocation: %d", id);
+	return &(p->allocations[id-1]);
+}
+
+// fill(buffer, data, offset)
+static int fill_allocation(lua_State* L)
+{
+	bufferobject* b = (bufferobject*)lua_touserdata(L, 1);
+	bufferobject_fill(L, b, 2, lua_tointeger(L, 3));
+	return 0;
+}
+
+static int l_bufferpool_alloc(lua_State* L)
+{
+	bufferpool* p = l_checkbufferpool(L, 1);
+	bufferobject* b = p->buffer;
+	int has_data = l_isbufferdata(L, 2);
+	GLsizei size = has_data ? bufferobject_data_count(L, b, 2) : luaL_checkinteger(L, 2);
+	GLsizei align = luaL_optinteger(L, 3, 1);
+	if (size <= 0)
+		return luaL_error(L, "Invalid allocation size: %d", size);
+	if (align <= 0)
+		return luaL_error(L, "Invalid alignment: %d", align);
+
+	while (GL_NO_ERROR != glGetError())
+		/*clear error flags*/;
+
+	GLsizei offset = take_range(L, p, size, align);
+	if (offset < 0)
+	{
+		grow_pool(L, p, size + align);
+		offset = take_range(L, p, size, align);
+	}
+
+	// reuse a released handle if there is one
+	int id = 0;
+	while (id < p->allocation_count && p->allocations[id].used)
+		++id;
+	if (id == p->allocation_count)
+	{
+		p->allocations = (poolallocation*)reserve_list(L, p->allocations, &p->allocation_max,
+		                                               p->allocation_count + 1, sizeof(poolallocation));
+		++p->allocation_count;
+	}
+
+	poolallocation* a = &(p->allocations[id]);
+	a->offset = offset;
+	a->size = size;
+	a->align = align;
+	a->used = 1;
+
+	// the block is released if the data cannot be written
+	int status = 0;
+	if (has_data)
+	{
+		lua_pushcfunction(L, fill_allocation);
+		lua_pushlightuserdata(L, b);
+		lua_pushvalue(L, 2);
+		lua_pushinteger(L, offset);
+		status = lua_pcall(L, 3, 0, 0);
+	}
+	if (0 == status && GL_NO_ERROR != glGetError())
+	{
+		lua_pushliteral(L, "Unable to create data storage");
+		status = 1;
+	}
+	if (0 != status)
+	{
+		release_range(L, p, offset, size);
+		a->used = 0;
+		return lua_error(L);
+	}
+
+	lua_pushinteger(L, id + 1);
+	lua_pushinteger(L, offset + 1);
+	lua_pushinteger(L, size);
+	return 3;
+}
+
+static int l_bufferpool_free(lua_State* L)
+{
+	bufferpool* p = l_checkbufferpool(L, 1);
+	poolallocation* a = check_allocation(L, p, 2);
+
+	release_range(L, p, a->offset, a->size);
+	a->used = 0;
+	return 0;
+}
+
+static int l_bufferpool_update(lua_State* L)
+{
+	bufferpool* p = l_checkbufferpool(L, 1);
+	poolallocation* a = check_allocation(L, p, 2);
+	if (!l_isbufferdata(L, 3))
+		return luaL_typerror(L, 3, "table, string or array");
+
+	int count = bufferobject_data_count(L, p->buffer, 3);
+	if (count > a->size)
+		return luaL_error(L, "Data exceeds allocation: %d > %d elements", count, a->size);
+
+	bufferobject_fill(L, p->buffer, 3, a->offset);
+
+	lua_settop(L, 1);
+	return 1;
+}
+
+static int l_bufferpool_range(lua_State* L)
+{
+	bufferpool* p = l_checkbufferpool(L, 1);
+	poolallocation* a = check_allocation(L, p, 2);
+
+	lua_pushinteger(L, a->offset + 1);
+	lua_pushinteger(L, a->size);
+	return 2;
+}
+
+static int compare_offsets(const void* a, const void* b)
+{
+	const poolallocation* x = *(const poolallocation**)a;
+	const poolallocation* y = *(const poolallocation**)b;
+	return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+// moves all allocations to the front of new storage. the contents are
+// copied on the GPU. allocation handles stay valid, but their ranges change.
+static int l_bufferpool_defragment(lua_State* L)
+{
+	bufferpool* p = l_checkbufferpool(L, 1);
+	bufferobject* b = p->buffer;
+
+	int used = 0;
+	poolallocation** sorted = (poolallocation**)malloc((p->allocation_count + 1) * sizeof(poolallocation*));
+	if (NULL == sorted)
+		return luaL_error(L, "Out of memory");
+	for (int i = 0; i < p->allocation_count; ++i)
+	{
+		if (p->allocations[i].used)
+			sorted[used++] = &(p->allocations[i]);
+	}
+	qsort(sorted, used, sizeof(poolallocation*), compare_offsets);
+
+	GLuint id;
+	glGenBuffers(1, &id);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+	glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)b->capacity * b->element_size, NULL, b->usage);
+	glBindBuffer(GL_COPY_READ_BUFFER, b->id);
+
+	// only alignment gaps remain free in front of the last allocation
+	p->free_count = 0;
+	GLsizei cursor = 0;
+	for (int i = 0; i < used; ++i)
+	{
+		poolallocation* a = sorted[i];
+		GLsizei offset = align_up(cursor, a->align);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+		                    (GLintptr)a->offset * b->element_size,
+		                    (GLintptr)offset * b->element_size,
+		                    (GLsizeiptr)a->size * b->element_size);
+		release_range(L, p, cursor, offset - cursor);
+		a->offset = offset;
+		cursor = offset + a->size;
+	}
+	free(sorted);
+	release_range(L, p, cursor, b->capacity - cursor);
+
+	glDeleteBuffers(1, &b->id);
+	b->id = id;
+
+	lua_settop(L, 1);
+	return 1;
+}
+
+static int l_bufferpool_stats(lua_State* L)
+{
+	bufferpool* p = l_checkbufferpool(L, 1);
+
+	int allocations = 0;
+	GLsizei used = 0, largest_free = 0;
+	for (int i = 0; i < p->allocation_count; ++i)
+	{
+		if (!p->allocations[i].used)
+			continue;
+		++allocations;
+		used += p->allocations[i].size;
+	}
+	for (int i = 0; i < p->free_count; ++i)
+	{
+		if (p->free_ranges[i].size > largest_free)
+			largest_free = p->free_ranges[i].size;
+	}
+
+	lua_createtable(L, 0, 6);
+	lua_pushinteger(L, p->buffer->capacity);
+	lua_setfield(L, -2, "capacity");
+	lua_pushinteger(L, used);
+	lua_setfield(L, -2, "used");
+	lua_pushinteger(L, p->buffer->capacity - used);
+	lua_setfield(L, -2, "free");
+	lua_pushinteger(L, allocations);
+	lua_setfield(L, -2, "allocations");
+	lua_pushinteger(L, largest_free);
+	lua_setfield(L, -2, "largest_free");
+	lua_pushinteger(L, p->free_count);
+	lua_setfield(L, -2, "free_ranges");
+	return 1;
+}
+
+static int l_bufferpool___index(lua_State* L)
+{
+	luaL_getmetatable(L, INTERNAL_NAME);
+	lua_pushvalue(L, 2);
+	lua_rawget(L, -2);
+	if (!lua_isnoneornil(L, -1))
+		return 1;
+
+	bufferpool* p = (bufferpool*)lua_touserdata(L, 1);
+	const char* key = luaL_checkstring(L, 2);
+	if (0 == strcmp(key, "buffer"))
+	{
+		luaL_getmetatable(L, BUFFERS_NAME);
+		lua_pushlightuserdata(L, p);
+		lua_rawget(L, -2);
+	}
+	else
+	{
+		lua_pushnil(L);
+	}
+	return 1;
+}
+
+static int l_bufferpool___gc(lua_State* L)
+{
+	bufferpool* p = (bufferpool*)lua_touserdata(L, 1);
+
+	luaL_getmetatable(L, BUFFERS_NAME);
+	lua_pushlightuserdata(L, p);
+	lua_pushnil(L);
+	lua_rawset(L, -3);
+
+	free(p->free_ranges);
+	free(p->allocations);
+	p->free_ranges = NULL;
+	p->allocations = NULL;
+	return 0;
+}
+
+int l_bufferpool_new(lua_State* L)
+{
+	if (!context_available())
+		return luaL_error(L, "No OpenGL context available. Create a window first.");
+
+	assert_extension(L, ARB_copy_buffer);
+
+	GLenum target = GL_ARRAY_BUFFER;
+	GLenum usage = GL_STATIC_DRAW;
+	GLenum element_type = GL_FLOAT;
+
+	int top = lua_gettop(L);
+	GLsizei capacity = luaL_checkinteger(L, top);
+	if (capacity <= 0)
+		return luaL_error(L, "Invalid capacity: %d", capacity);
+
+	if (top > 1)
+		target       = luaL_checkinteger(L, 1);
+	if (top > 2)
+		usage        = luaL_checkinteger(L, 2);
+	if (top > 3)
+		element_type = luaL_checkinteger(L, 3);
+
+	bufferpool* p = (bufferpool*)lua_newuserdata(L, sizeof(bufferpool));
+	p->buffer = NULL;
+	p->free_ranges = NULL;
+	p->free_count = 0;
+	p->free_max = 0;
+	p->allocations = NULL;
+	p->allocation_count = 0;
+	p->allocation_max = 0;
+
+	if (luaL_newmetatable(L, INTERNAL_NAME))
+	{
+		luaL_reg meta[] =
+		{
+			{"__gc",       l_bufferpool___gc},
+			{"__index",    l_bufferpool___index},
+			{"alloc",      l_bufferpool_alloc},
+			{"free",       l_bufferpool_free},
+			{"update",     l_bufferpool_update},
+			{"range",      l_bufferpool_range},
+			{"defragment", l_bufferpool_defragment},
+			{"stats",      l_bufferpool_stats},
+			{NULL, NULL}
+		};
+		l_registerFunctions(L, -1, meta);
+	}
+	lua_setmetatable(L, -2);
+
+	while (GL_NO_ERROR != glGetError())
+		/*clear error flags*/;
+
+	// the pool's buffer is always `full': draw ranges are managed by the pool
+	bufferobject* b = l_bufferobject_push(L, target, usage, element_type);
+	bufferobject_reserve(b, capacity);
+	b->count = capacity;
+	b->pooled = 1;
+	p->buffer = b;
+	release_range(L, p, 0, capacity);
+
+	if (GL_NO_ERROR != glGetError())
+		return luaL_error(L, "Unable to create data storage");
+
+	// keep buffer alive as long as the pool
+	luaL_newmetatable(L, BUFFERS_NAME);
+	lua_pushlightuserdata(L, p);
+	lua_pushvalue(L, -3);
+	lua_rawset(L, -3);
+	lua_pop(L, 2);
+
+	return 1;
+}
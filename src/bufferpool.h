@@ -0,0 +1,41 @@
+#ifndef __G4L_BUFFERPOOL_H
+#define __G4L_BUFFERPOOL_H
+
+#include <glew.h>
+#include "bufferobject.h"
+
+struct lua_State;
+
+typedef struct
+{
+	GLsizei offset;
+	GLsizei size;
+} poolrange;
+
+typedef struct
+{
+	GLsizei offset;
+	GLsizei size;
+	GLsizei align;
+	int     used;
+} poolallocation;
+
+typedef struct
+{
+	bufferobject* buffer;
+
+	// sorted by offset, adjacent ranges are merged
+	poolrange* free_ranges;
+	int        free_count;
+	int        free_max;
+
+	// allocation handles are indices into this list
+	poolallocation* allocations;
+	int             allocation_count;
+	int             allocation_max;
+} bufferpool;
+
+bufferpool* l_checkbufferpool(struct lua_State* L, int idx);
+int l_bufferpool_new(struct lua_State* L);
+
+#endif
@@ -0,0 +1,95 @@
+#include "filewatch.h"
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include <string.h>
+
+#ifdef __linux__
+#  include <sys/inotify.h>
+#  include <unistd.h>
+#endif
+
+static const char* WATCHES_NAME = "G4L.filewatch";
+
+#ifdef __linux__
+static int watch_fd = -1;
+#endif
+
+void filewatch_add(lua_State* L, const char* path)
+{
+	// directories are watched instead of files, because editors often
+	// replace files instead of writing to them
+	const char* slash = strrchr(path, '/');
+	if (NULL == slash)
+		lua_pushliteral(L, ".");
+	else if (slash == path)
+		lua_pushliteral(L, "/");
+	else
+		lua_pushlstring(L, path, slash - path);
+
+	const char* dir = lua_tostring(L, -1);
+	lua_pushfstring(L, "%s/%s", dir, (NULL == slash) ? path : slash + 1);
+
+#ifdef __linux__
+	if (watch_fd < 0)
+		watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	int wd = (watch_fd < 0) ? -1 : inotify_add_watch(watch_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (wd >= 0)
+	{
+		luaL_newmetatable(L, WATCHES_NAME);
+		lua_pushvalue(L, -3);
+		lua_rawseti(L, -2, wd);
+		lua_pop(L, 1);
+	}
+#endif
+
+	lua_remove(L, -2);
+}
+
+int filewatch_poll(lua_State* L)
+{
+#ifdef __linux__
+	if (watch_fd < 0)
+		return 0;
+
+	union
+	{
+		struct inotify_event event;
+		char buf[4096];
+	} events;
+
+	lua_newtable(L);
+	luaL_newmetatable(L, WATCHES_NAME);
+
+	int count = 0;
+	ssize_t len;
+	while ((len = read(watch_fd, events.buf, sizeof(events.buf))) > 0)
+	{
+		for (char* p = events.buf; p < events.buf + len;)
+		{
+			struct inotify_event* e = (struct inotify_event*)p;
+			p += sizeof(struct inotify_event) + e->len;
+			if (0 == e->len)
+				continue;
+
+			lua_rawgeti(L, -1, e->wd);
+			if (lua_isstring(L, -1))
+			{
+				lua_pushfstring(L, "%s/%s", lua_tostring(L, -1), e->name);
+				lua_pushboolean(L, 1);
+				lua_rawset(L, -5);
+				++count;
+			}
+			lua_pop(L, 1);
+		}
+	}
+
+	lua_pop(L, (count > 0) ? 1 : 2);
+	return count;
+#else
+	(void)L;
+	return 0;
+#endif
+}
@@ -0,0 +1,14 @@
+#ifndef __G4L_FILEWATCH_H
+#define __G4L_FILEWATCH_H
+
+struct lua_State;
+
+// watches file at `path' for changes and pushes the name under which
+// filewatch_poll() reports them
+void filewatch_add(struct lua_State* L, const char* path);
+
+// pushes a set of files that changed since the last poll and returns
+// their number. pushes nothing if there are none.
+int filewatch_poll(struct lua_State* L);
+
+#endif
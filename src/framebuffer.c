@@ -44,27 +44,42 @@ static int l_framebuffer_add_attachment(lua_State* L)
 {
 	framebuffer* fbo = l_checkframebuffer(L, 1);
 	int unit = luaL_optinteger(L, 2, 1);
+	GLenum format = luaL_optinteger(L, 3, GL_RGBA8);
 
 	// generate new texture
 	lua_pushcfunction(L, l_texture_new);
 	lua_pushinteger(L, fbo->width);
 	lua_pushinteger(L, fbo->height);
 	lua_pushinteger(L, unit);
-	lua_call(L, 3, 1);
+	for (int i = 0; i < 4; ++i)
+		lua_pushnil(L);
+	lua_pushinteger(L, format);
+	lua_call(L, 8, 1);
 	texture* tex = l_checktexture(L, -1);
 
-	// register texture
+	// register texture. depth textures replace the depth attachment and
+	// are not counted as color attachment
+	GLenum point;
 	luaL_getmetatable(L, ATTACHMENTS_NAME);
 	lua_rawgeti(L, -1, fbo->id);
-	int attachment = lua_objlen(L, -1);
 	lua_pushvalue(L, -3);
-	lua_rawseti(L, -2, attachment+1);
+	if (GL_DEPTH_STENCIL == tex->format->format || GL_DEPTH_COMPONENT == tex->format->format)
+	{
+		point = (GL_DEPTH_STENCIL == tex->format->format) ?
+			GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+		lua_setfield(L, -2, "depth");
+	}
+	else
+	{
+		int attachment = lua_objlen(L, -2);
+		point = GL_COLOR_ATTACHMENT0 + attachment;
+		lua_rawseti(L, -2, attachment+1);
+	}
 
 	// attach texture
 	with_framebuffer(fbo->id)
 	{
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + attachment,
-		                       GL_TEXTURE_2D, tex->id, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, point, GL_TEXTURE_2D, tex->id, 0);
 	}
 
 	// return texture object
@@ -1,10 +1,12 @@
 #include "image.h"
 #include "helper.h"
+#include "array.h"
 
 #include <lua.h>
 #include <lauxlib.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <zlib.h>
 #include <png.h>
@@ -13,38 +15,122 @@
 
 static const char *INTERNAL_NAME = "G4L.image";
 
+static const pixelformat FORMATS[] =
+{
+	{GL_RGBA8,              GL_RGBA,            GL_UNSIGNED_BYTE,     4, 4},
+	{GL_SRGB8_ALPHA8,       GL_RGBA,            GL_UNSIGNED_BYTE,     4, 4},
+	{GL_R8,                 GL_RED,             GL_UNSIGNED_BYTE,     1, 1},
+	{GL_RG8,                GL_RG,              GL_UNSIGNED_BYTE,     2, 2},
+	{GL_R16F,               GL_RED,             GL_FLOAT,             1, 4},
+	{GL_RGBA16F,            GL_RGBA,            GL_FLOAT,             4, 16},
+	{GL_R32F,               GL_RED,             GL_FLOAT,             1, 4},
+	{GL_DEPTH24_STENCIL8,   GL_DEPTH_STENCIL,   GL_UNSIGNED_INT_24_8, 2, 4},
+	{GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT,             1, 4},
+	{0, 0, 0, 0, 0}
+};
+
+const pixelformat* image_pixelformat(GLenum internal)
+{
+	for (const pixelformat* f = FORMATS; 0 != f->internal; ++f)
+		if (internal == f->internal)
+			return f;
+	return NULL;
+}
+
 image *l_checkimage(lua_State *L, int idx)
 {
 	return (image *)luaL_checkudata(L, idx, INTERNAL_NAME);
 }
 
+static lua_Number clamp01(lua_Number v)
+{
+	return v < 0. ? 0. : (v > 1. ? 1. : v);
+}
+
+// reads the channels of pixel `i'. fixed point channels are in [0:1].
+static void get_pixel(const image *img, size_t i, lua_Number *v)
+{
+	const pixelformat *f = img->format;
+	if (GL_FLOAT == f->type)
+	{
+		const GLfloat *p = (const GLfloat *)img->data + i * f->channels;
+		for (int c = 0; c < f->channels; ++c)
+			v[c] = p[c];
+	}
+	else if (GL_UNSIGNED_INT_24_8 == f->type)
+	{
+		GLuint p = ((const GLuint *)img->data)[i];
+		v[0] = (lua_Number)(p >> 8) / 16777215.;
+		v[1] = (lua_Number)(p & 0xff) / 255.;
+	}
+	else
+	{
+		const unsigned char *p = (const unsigned char *)img->data + i * f->channels;
+		for (int c = 0; c < f->channels; ++c)
+			v[c] = (lua_Number)p[c] / 255.;
+	}
+}
+
+static void set_pixel(image *img, size_t i, const lua_Number *v)
+{
+	const pixelformat *f = img->format;
+	if (GL_FLOAT == f->type)
+	{
+		GLfloat *p = (GLfloat *)img->data + i * f->channels;
+		for (int c = 0; c < f->channels; ++c)
+			p[c] = (GLfloat)v[c];
+	}
+	else if (GL_UNSIGNED_INT_24_8 == f->type)
+	{
+		GLuint depth = (GLuint)(clamp01(v[0]) * 16777215.);
+		GLuint stencil = (GLuint)(clamp01(v[1]) * 255.);
+		((GLuint *)img->data)[i] = (depth << 8) | stencil;
+	}
+	else
+	{
+		unsigned char *p = (unsigned char *)img->data + i * f->channels;
+		for (int c = 0; c < f->channels; ++c)
+			p[c] = (unsigned char)(clamp01(v[c]) * 255.);
+	}
+}
+
+static size_t check_pixel(lua_State *L, image *img)
+{
+	int x = luaL_checkinteger(L, 2);
+	int y = luaL_checkinteger(L, 3);
+
+	if (x < 0 || x >= img->width || y < 0 || y >= img->height)
+		luaL_error(L, "Pixel out of range: %dx%d", x,y);
+	return (size_t)x + (size_t)y * img->width;
+}
+
 static int l_image_map(lua_State *L)
 {
 	image *img = l_checkimage(L, 1);
 	if (!lua_isfunction(L, 2))
 		return luaL_typerror(L, 2, "function");
 
-	rgba_pixel *pixel = (rgba_pixel *)img->data;
+	int channels = img->format->channels;
+	lua_Number v[4];
 	for (int x = 0; x < img->width; ++x)
 	{
 		for (int y = 0; y < img->height; ++y)
 		{
+			size_t i = (size_t)x + (size_t)y * img->width;
+			get_pixel(img, i, v);
+
 			lua_pushvalue(L, 2);
 			lua_pushinteger(L, x);
 			lua_pushinteger(L, y);
-			lua_pushnumber(L, (lua_Number)(pixel->r) / 255.);
-			lua_pushnumber(L, (lua_Number)(pixel->g) / 255.);
-			lua_pushnumber(L, (lua_Number)(pixel->b) / 255.);
-			lua_pushnumber(L, (lua_Number)(pixel->a) / 255.);
-			lua_call(L, 6, 4);
-
-			pixel->r = (unsigned char)(lua_tonumber(L, -4) * 255.);
-			pixel->g = (unsigned char)(lua_tonumber(L, -3) * 255.);
-			pixel->b = (unsigned char)(lua_tonumber(L, -2) * 255.);
-			pixel->a = (unsigned char)(lua_tonumber(L, -1) * 255.);
-
-			lua_pop(L, 4);
-			++pixel;
+			for (int c = 0; c < channels; ++c)
+				lua_pushnumber(L, v[c]);
+			lua_call(L, 2 + channels, channels);
+
+			for (int c = 0; c < channels; ++c)
+				v[c] = lua_tonumber(L, c - channels);
+			set_pixel(img, i, v);
+
+			lua_pop(L, channels);
 		}
 	}
 
@@ -55,37 +141,24 @@ static int l_image_map(lua_State *L)
 static int l_image_get(lua_State *L)
 {
 	image *img = l_checkimage(L, 1);
-	int x = luaL_checkinteger(L, 2);
-	int y = luaL_checkinteger(L, 3);
+	size_t i = check_pixel(L, img);
 
-	if (x < 0 || x >= img->width || y < 0 || y > img->height)
-		return luaL_error(L, "Pixel out of range: %dx%d", x,y);
-
-	rgba_pixel *p = (rgba_pixel *)(img->data) + (x + y * img->width);
-	lua_pushnumber(L, (lua_Number)(p->r) / 255.);
-	lua_pushnumber(L, (lua_Number)(p->g) / 255.);
-	lua_pushnumber(L, (lua_Number)(p->b) / 255.);
-	lua_pushnumber(L, (lua_Number)(p->a) / 255.);
-	return 4;
+	lua_Number v[4];
+	get_pixel(img, i, v);
+	for (int c = 0; c < img->format->channels; ++c)
+		lua_pushnumber(L, v[c]);
+	return img->format->channels;
 }
 
 static int l_image_set(lua_State *L)
 {
 	image *img = l_checkimage(L, 1);
-	int x = luaL_checkinteger(L, 2);
-	int y = luaL_checkinteger(L, 3);
-
-	if (x < 0 || x >= img->width || y < 0 || y > img->height)
-		return luaL_error(L, "Pixel out of range: %dx%d", x,y);
-
-	rgba_pixel new_pixel;
-	new_pixel.r = (unsigned char)(luaL_checknumber(L, 4) * 255.);
-	new_pixel.g = (unsigned char)(luaL_checknumber(L, 5) * 255.);
-	new_pixel.b = (unsigned char)(luaL_checknumber(L, 6) * 255.);
-	new_pixel.a = (unsigned char)(luaL_checknumber(L, 7) * 255.);
+	size_t i = check_pixel(L, img);
 
-	rgba_pixel *p = (rgba_pixel *)(img->data) + 4 * (x + y * img->width);
-	*p = new_pixel;
+	lua_Number v[4];
+	for (int c = 0; c < img->format->channels; ++c)
+		v[c] = luaL_checknumber(L, 4 + c);
+	set_pixel(img, i, v);
 
 	lua_settop(L, 1);
 	return 1;
@@ -109,6 +182,10 @@ static int l_image___index(lua_State *L)
 	{
 		lua_pushinteger(L, img->height);
 	}
+	else if (0 == strcmp(key, "format"))
+	{
+		lua_pushinteger(L, img->format->internal);
+	}
 	else
 	{
 		lua_pushnil(L);
@@ -154,19 +231,57 @@ int l_image_new(lua_State *L)
 	return 1;
 }
 
+static const pixelformat *check_format(lua_State *L, int idx)
+{
+	GLenum internal = luaL_optinteger(L, idx, GL_RGBA8);
+	const pixelformat *f = image_pixelformat(internal);
+	if (NULL == f)
+		luaL_error(L, "Invalid image format: %d", internal);
+	return f;
+}
+
 static void push_image_from_dimensions(lua_State *L, int idx)
 {
 	int w = luaL_checkinteger(L, idx);
 	int h = luaL_checkinteger(L, idx+1);
+	int has_array = l_isarray(L, idx+2);
+	const pixelformat *f = check_format(L, lua_isnumber(L, idx+2) ? idx+2 : idx+3);
 
 	image *img = (image *)lua_newuserdata(L, sizeof(image));
 	img->width  = w;
 	img->height = h;
-	img->data   = malloc(w * h * 4);
+	img->format = f;
+	img->data   = malloc((size_t)w * h * f->size);
 	// leave img->data uncleared for glitchy effects :)
 
 	if (!img->data)
 		luaL_error(L, "Cannot allocate image memory");
+
+	if (!has_array)
+		return;
+
+	// initialize from array with one value per channel: ubyte is copied to
+	// ubyte images and float to float images. otherwise ubyte is in
+	// [0:255] and float in [0:1].
+	array *a = (array *)lua_touserdata(L, idx+2);
+	if (a->count != w * h * f->channels)
+		luaL_error(L, "Array size does not match image size: %d vs. %d",
+		           a->count, w * h * f->channels);
+
+	if (a->element_type == f->type && a->element_size * f->channels == f->size)
+	{
+		memcpy(img->data, a->data, (size_t)w * h * f->size);
+		return;
+	}
+
+	lua_Number scale = (GL_UNSIGNED_BYTE == a->element_type) ? 1. / 255. : 1.;
+	lua_Number v[4];
+	for (int i = 0; i < w * h; ++i)
+	{
+		for (int c = 0; c < f->channels; ++c)
+			v[c] = array_get(a, i * f->channels + c) * scale;
+		set_pixel(img, i, v);
+	}
 }
 
 typedef struct encoded_info
@@ -192,6 +307,11 @@ static void push_image_from_string(lua_State *L, int idx)
 	decoded_info decoded = {0,0, NULL};
 	encoded.data = (void*)lua_tolstring(L, idx, &encoded.size);
 
+	// decoded images are always 8 bit RGBA, but may be in sRGB space
+	const pixelformat *f = check_format(L, idx+1);
+	if (4 != f->channels || GL_UNSIGNED_BYTE != f->type)
+		luaL_error(L, "Invalid format for encoded image: %d", f->internal);
+
 	png_byte signature[8];
 	memcpy(signature, encoded.data, 8);
 	int is_png = png_sig_cmp(signature, 0, 8);
@@ -208,6 +328,7 @@ static void push_image_from_string(lua_State *L, int idx)
 	image *img = (image *)lua_newuserdata(L, sizeof(image));
 	img->width  = decoded.width;
 	img->height = decoded.height;
+	img->format = f;
 	img->data   = decoded.data;
 }
 
@@ -1,22 +1,30 @@
 #ifndef __G4L_IMAGE_H
 #define __G4L_IMAGE_H
 
+#include <glew.h>
+
 struct lua_State;
 
+// how the pixels of an image are stored and uploaded to a texture
+typedef struct
+{
+	GLenum internal; // texture format
+	GLenum format;   // pixel format and type of the image data
+	GLenum type;
+	int    channels;
+	int    size;     // bytes per pixel
+} pixelformat;
+
 typedef struct
 {
 	int width;
 	int height;
+	const pixelformat* format;
 	void* data;
 } image;
 
-typedef struct
-{
-	unsigned char r;
-	unsigned char g;
-	unsigned char b;
-	unsigned char a;
-} rgba_pixel;
+// returns NULL if `internal' is not a supported texture format
+const pixelformat* image_pixelformat(GLenum internal);
 
 image* l_checkimage(struct lua_State *L, int idx);
 int l_image_new(struct lua_State *L);
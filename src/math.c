@@ -651,6 +651,14 @@ static int l_vec_new(lua_State* L)
 	return 1;
 }
 
+void l_pushvec(lua_State* L, int dim, const GLfloat* v)
+{
+	lua_pushcfunction(L, l_vec_new);
+	for (int i = 0; i < dim; ++i)
+		lua_pushnumber(L, v[i]);
+	lua_call(L, dim, 1);
+}
+
 ////< MATRIX >//////////////////////////////////////////////////////////////////////
 //
 #define FOR_MAT_ITER(var, max, expr) do { int var = 0; \
@@ -1199,6 +1207,14 @@ static int l_mat_new(lua_State* L)
 	return 1;
 }
 
+void l_pushmat(lua_State* L, int n, const GLfloat* m)
+{
+	lua_pushcfunction(L, l_mat_new);
+	for (int i = 0; i < n*n; ++i)
+		lua_pushnumber(L, m[i]);
+	lua_call(L, n*n, 1);
+}
+
 ////< MODULE >//////////////////////////////////////////////////////////////////////
 
 #define __normalize_vec3(r, v) do { \
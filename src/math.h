@@ -44,6 +44,10 @@ void* l_checkmat(int n, int k, lua_State* L, int idx);
 #define l_checkmat33(L, idx) (mat33*)(l_checkmat(3,3, L, idx))
 #define l_checkmat44(L, idx) (mat44*)(l_checkmat(4,4, L, idx))
 
+// push new vector/matrix. matrix elements are in row major order.
+void l_pushvec(lua_State* L, int dim, const GLfloat* v);
+void l_pushmat(lua_State* L, int n, const GLfloat* m);
+
 int luaopen_G4L_math(lua_State* L);
 
 #endif
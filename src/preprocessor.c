@@ -0,0 +1,285 @@
+#include "preprocessor.h"
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* PATH_NAME = "G4L.shaderpath";
+static const int MAX_INCLUDE_DEPTH = 32;
+
+int preprocessor_read(lua_State* L, const char* path)
+{
+	FILE* fp = fopen(path, "rb");
+	if (NULL == fp)
+		return 0;
+
+	// directories can be opened, but not read
+	if ((EOF == fgetc(fp) && ferror(fp)) || 0 != fseek(fp, 0, SEEK_END))
+	{
+		fclose(fp);
+		return -1;
+	}
+	long bytes = ftell(fp);
+	if (bytes < 0 || 0 != fseek(fp, 0, SEEK_SET))
+	{
+		fclose(fp);
+		return -1;
+	}
+
+	char* buf = (char*)malloc(bytes);
+	if (NULL == buf)
+	{
+		fclose(fp);
+		return luaL_error(L, "Out of memory");
+	}
+	size_t read = fread(buf, 1, bytes, fp);
+	int failed = ferror(fp);
+	fclose(fp);
+
+	if (failed)
+	{
+		free(buf);
+		return -1;
+	}
+	lua_pushlstring(L, buf, read);
+	free(buf);
+	return 1;
+}
+
+// pushes contents of the include file at `path'. returns 0 if it does not
+// exist.
+static int read_include(lua_State* L, const char* path)
+{
+	int found = preprocessor_read(L, path);
+	if (found < 0)
+		luaL_error(L, "Cannot read include file `%s'", path);
+	return found;
+}
+
+// pushes contents of the first file named `name' in the search path
+static void push_include(lua_State* L, const char* name)
+{
+	lua_getfield(L, LUA_REGISTRYINDEX, PATH_NAME);
+	int n = lua_istable(L, -1) ? (int)lua_objlen(L, -1) : 0;
+	if ('/' == name[0] || 0 == n)
+	{
+		lua_pop(L, 1);
+		if (!read_include(L, name))
+			luaL_error(L, "Cannot find include `%s'", name);
+		return;
+	}
+
+	for (int i = 1; i <= n; ++i)
+	{
+		lua_rawgeti(L, -1, i);
+		lua_pushfstring(L, "%s/%s", lua_tostring(L, -1), name);
+		int found = read_include(L, lua_tostring(L, -1));
+		if (found)
+		{
+			lua_replace(L, -4);
+			lua_pop(L, 2);
+			return;
+		}
+		lua_pop(L, 2);
+	}
+	luaL_error(L, "Cannot find include `%s'", name);
+}
+
+// returns length of the file name if `line' is an #include directive
+static size_t include_name(const char* line, const char* end, const char** name)
+{
+	const char* p = line;
+	while (p < end && isspace((unsigned char)*p)) ++p;
+	if (p == end || '#' != *p++) return 0;
+	while (p < end && isspace((unsigned char)*p)) ++p;
+	if ((size_t)(end - p) < 7 || 0 != strncmp(p, "include", 7)) return 0;
+	p += 7;
+	while (p < end && isspace((unsigned char)*p)) ++p;
+	if (p == end) return 0;
+
+	char close = ('<' == *p) ? '>' : '"';
+	if ('"' != *p && '<' != *p) return 0;
+
+	*name = ++p;
+	while (p < end && close != *p) ++p;
+	return (p < end) ? (size_t)(p - *name) : 0;
+}
+
+// returns end of the #version line, or `source' if there is none
+static const char* version_end(const char* source)
+{
+	const char* p = source;
+	while (isspace((unsigned char)*p)) ++p;
+	if (0 != strncmp(p, "#version", 8))
+		return source;
+
+	const char* eol = strchr(p, '\n');
+	return (NULL != eol) ? eol + 1 : p + strlen(p);
+}
+
+static int count_lines(const char* begin, const char* end)
+{
+	int n = 0;
+	for (const char* p = begin; p < end; ++p)
+		n += ('\n' == *p);
+	return n;
+}
+
+static int compare_strings(const void* a, const void* b)
+{
+	return strcmp(*(const char**)a, *(const char**)b);
+}
+
+// pushes one string with a #define line for each entry of the table at
+// `idx'. {"NAME", NAME = value, NAME = true} are defined, NAME = false is
+// not. lines are sorted, so equal tables give equal sources.
+static void push_defines(lua_State* L, int idx)
+{
+	lua_newtable(L);
+	int t = lua_gettop(L), n = 0;
+
+	lua_pushnil(L);
+	while (lua_next(L, idx))
+	{
+		int key = lua_type(L, -2);
+		if (LUA_TNUMBER == key && LUA_TSTRING == lua_type(L, -1))
+			lua_pushfstring(L, "#define %s\n", lua_tostring(L, -1));
+		else if (LUA_TSTRING == key && lua_isboolean(L, -1) && lua_toboolean(L, -1))
+			lua_pushfstring(L, "#define %s\n", lua_tostring(L, -2));
+		else if (LUA_TSTRING == key && lua_isboolean(L, -1))
+			lua_pushnil(L);
+		else if (LUA_TSTRING == key && lua_isstring(L, -1))
+			lua_pushfstring(L, "#define %s %s\n", lua_tostring(L, -2), lua_tostring(L, -1));
+		else
+			luaL_error(L, "Invalid definition: %s = %s",
+			           luaL_typename(L, -2), luaL_typename(L, -1));
+
+		if (lua_isnil(L, -1))
+		{
+			lua_pop(L, 2);
+			continue;
+		}
+		lua_rawseti(L, t, ++n);
+		lua_pop(L, 1);
+	}
+
+	luaL_checkstack(L, n, "Too many definitions");
+	const char** lines = (const char**)malloc((n + 1) * sizeof(const char*));
+	if (NULL == lines)
+		luaL_error(L, "Out of memory");
+
+	for (int i = 0; i < n; ++i)
+	{
+		lua_rawgeti(L, t, i+1);
+		lines[i] = lua_tostring(L, -1); // still referenced by the table
+		lua_pop(L, 1);
+	}
+	qsort(lines, n, sizeof(const char*), compare_strings);
+
+	for (int i = 0; i < n; ++i)
+		lua_pushstring(L, lines[i]);
+	free(lines);
+
+	lua_concat(L, n);
+	lua_remove(L, t);
+}
+
+static void process(lua_State* L, int idx, int defines, int depth)
+{
+	if (depth > MAX_INCLUDE_DEPTH)
+		luaL_error(L, "Include depth exceeds %d. Recursive #include?", MAX_INCLUDE_DEPTH);
+
+	const char* source = lua_tostring(L, idx);
+	const char* line = source;
+	int lineno = 1;
+
+	// definitions need to follow #version. #line keeps compiler messages
+	// pointing at lines of the original source.
+	if (0 != defines)
+	{
+		line = version_end(source);
+		lineno += count_lines(source, line);
+		lua_pushlstring(L, source, line - source);
+		push_defines(L, defines);
+		lua_pushfstring(L, "#line %d\n", lineno);
+		lua_concat(L, 3);
+	}
+
+	luaL_Buffer b;
+	luaL_buffinit(L, &b);
+	if (0 != defines)
+	{
+		lua_pushvalue(L, -1);
+		luaL_addvalue(&b);
+	}
+
+	while ('\0' != *line)
+	{
+		const char* eol = strchr(line, '\n');
+		const char* end = (NULL != eol) ? eol + 1 : line + strlen(line);
+
+		const char* name;
+		size_t len = include_name(line, end, &name);
+		if (0 == len)
+		{
+			luaL_addlstring(&b, line, end - line);
+			line = end;
+			++lineno;
+			continue;
+		}
+
+		lua_pushlstring(L, name, len);
+		push_include(L, lua_tostring(L, -1));
+		process(L, lua_gettop(L), 0, depth + 1);
+		lua_replace(L, -3);
+		lua_pop(L, 1);
+		luaL_addvalue(&b);
+		luaL_addchar(&b, '\n');
+		lua_pushfstring(L, "#line %d\n", ++lineno);
+		luaL_addvalue(&b);
+		line = end;
+	}
+
+	luaL_pushresult(&b);
+	if (0 != defines)
+		lua_remove(L, -2);
+}
+
+void preprocess(lua_State* L, int idx, int defines)
+{
+	const char* source = lua_tostring(L, idx);
+	if (0 == defines && NULL == strstr(source, "include"))
+	{
+		lua_pushvalue(L, idx);
+		return;
+	}
+	process(L, idx, defines, 0);
+}
+
+int l_preprocess(lua_State* L)
+{
+	luaL_checkstring(L, 1);
+	if (!lua_isnoneornil(L, 2))
+		luaL_checktype(L, 2, LUA_TTABLE);
+	preprocess(L, 1, lua_isnoneornil(L, 2) ? 0 : 2);
+	return 1;
+}
+
+// sets the directories that are searched for #include files
+int l_preprocessor_setPath(lua_State* L)
+{
+	int n = lua_gettop(L);
+	lua_createtable(L, n, 0);
+	for (int i = 1; i <= n; ++i)
+	{
+		luaL_checkstring(L, i);
+		lua_pushvalue(L, i);
+		lua_rawseti(L, -2, i);
+	}
+	lua_setfield(L, LUA_REGISTRYINDEX, PATH_NAME);
+	return 0;
+}
@@ -0,0 +1,17 @@
+#ifndef __G4L_PREPROCESSOR_H
+#define __G4L_PREPROCESSOR_H
+
+struct lua_State;
+
+// pushes source at `idx' with #include directives resolved and the
+// definitions of the table at `defines' (0 if none) injected after #version
+void preprocess(struct lua_State* L, int idx, int defines);
+
+// pushes contents of file at `path'. returns 0 if it cannot be opened and
+// -1 if it cannot be read, e.g. because it is a directory.
+int preprocessor_read(struct lua_State* L, const char* path);
+
+int l_preprocess(struct lua_State* L);
+int l_preprocessor_setPath(struct lua_State* L);
+
+#endif
@@ -0,0 +1,167 @@
+#include "programcache.h"
+#include "helper.h"
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char MAGIC[4] = {'G', '4', 'L', 'P'};
+
+static char* directory = NULL;
+static unsigned int hits = 0;
+static unsigned int misses = 0;
+
+int programcache_enabled()
+{
+	return NULL != directory && GLEW_ARB_get_program_binary;
+}
+
+programkey programcache_feed(programkey k, const void* data, size_t len)
+{
+	// FNV-1a, 64 bit
+	const unsigned char* p = (const unsigned char*)data;
+	for (size_t i = 0; i < len; ++i)
+		k = (k ^ p[i]) * 1099511628211ull;
+	return k;
+}
+
+static programkey feed_string(programkey k, const char* str)
+{
+	if (NULL == str)
+		str = "";
+	// include the terminator to separate consecutive strings
+	return programcache_feed(k, str, strlen(str) + 1);
+}
+
+programkey programcache_begin()
+{
+	programkey k = 14695981039346656037ull;
+	k = feed_string(k, (const char*)glGetString(GL_VENDOR));
+	k = feed_string(k, (const char*)glGetString(GL_RENDERER));
+	k = feed_string(k, (const char*)glGetString(GL_VERSION));
+	return k;
+}
+
+// opens <directory>/<key>.bin
+static FILE* open_file(programkey k, const char* mode)
+{
+	size_t len = strlen(directory) + 22;
+	char* path = (char*)malloc(len);
+	if (NULL == path)
+		return NULL;
+
+	snprintf(path, len, "%s/%016llx.bin", directory, k);
+	FILE* f = fopen(path, mode);
+	free(path);
+	return f;
+}
+
+static GLuint load_binary(programkey k)
+{
+	FILE* f = open_file(k, "rb");
+	if (NULL == f)
+		return 0;
+
+	char magic[4];
+	GLenum format;
+	GLint length;
+	if (1 != fread(magic, sizeof(magic), 1, f) || 0 != memcmp(magic, MAGIC, sizeof(magic)) ||
+	    1 != fread(&format, sizeof(format), 1, f) ||
+	    1 != fread(&length, sizeof(length), 1, f) || length <= 0)
+	{
+		fclose(f);
+		return 0;
+	}
+
+	void* binary = malloc(length);
+	if (NULL == binary || 1 != fread(binary, length, 1, f))
+	{
+		free(binary);
+		fclose(f);
+		return 0;
+	}
+	fclose(f);
+
+	// the driver may reject binaries, e.g. after an update that did not
+	// change the version string
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, format, binary, length);
+	free(binary);
+
+	GLint status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (!status)
+	{
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+GLuint programcache_load(programkey k)
+{
+	GLuint program = load_binary(k);
+	if (0 != program)
+		++hits;
+	else
+		++misses;
+	return program;
+}
+
+// failing to store a binary is not an error: the program is compiled from
+// source again next time
+void programcache_store(programkey k, GLuint program)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	void* binary = malloc(length);
+	if (NULL == binary)
+		return;
+
+	GLenum format;
+	glGetProgramBinary(program, length, &length, &format, binary);
+
+	FILE* f = open_file(k, "wb");
+	if (NULL != f)
+	{
+		fwrite(MAGIC, sizeof(MAGIC), 1, f);
+		fwrite(&format, sizeof(format), 1, f);
+		fwrite(&length, sizeof(length), 1, f);
+		fwrite(binary, length, 1, f);
+		fclose(f);
+	}
+	free(binary);
+}
+
+int l_programcache_set(lua_State* L)
+{
+	const char* dir = luaL_optstring(L, 1, NULL);
+
+	free(directory);
+	directory = NULL;
+	hits = misses = 0;
+	if (NULL == dir)
+		return 0;
+
+	size_t len = strlen(dir);
+	directory = (char*)malloc(len + 1);
+	if (NULL == directory)
+		return luaL_error(L, "Out of memory");
+	memcpy(directory, dir, len + 1);
+
+	lua_pushboolean(L, programcache_enabled());
+	return 1;
+}
+
+int l_programcache_stats(lua_State* L)
+{
+	lua_pushinteger(L, hits);
+	lua_pushinteger(L, misses);
+	return 2;
+}
@@ -0,0 +1,26 @@
+#ifndef __G4L_PROGRAMCACHE_H
+#define __G4L_PROGRAMCACHE_H
+
+#include <glew.h>
+#include <stddef.h>
+
+struct lua_State;
+
+typedef unsigned long long programkey;
+
+// nonzero if a cache directory is set and the driver supports binaries
+int programcache_enabled();
+
+// keys are seeded with the driver strings, so binaries of other drivers
+// never match
+programkey programcache_begin();
+programkey programcache_feed(programkey k, const void* data, size_t len);
+
+// returns linked program or 0 if there is no usable binary for `k'
+GLuint programcache_load(programkey k);
+void programcache_store(programkey k, GLuint program);
+
+int l_programcache_set(struct lua_State* L);
+int l_programcache_stats(struct lua_State* L);
+
+#endif
@@ -2,96 +2,110 @@
 #include "helper.h"
 #include "bufferobject.h"
 #include "math.h"
-#include "texture.h"
+#include "uniform.h"
+#include "programcache.h"
+#include "preprocessor.h"
+#include "filewatch.h"
 
 #include <lua.h>
 #include <lauxlib.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#ifdef _MSC_VER
-#  include "float.h"
-#  define INFINITY (DBL_MAX+DBL_MAX)
-#  define NAN (INFINITY-INFINITY)
-#else
-#  define NAN (0./.0)
-#endif
-
-#ifndef APIENTRY
-#  if defined(__MINGW32__) || defined(__CYGWIN__)
-#    define APIENTRY __stdcall
-#  elif (_MSC_VER >= 800) || defined(_STDCALL_SUPPORTED) || defined(__BORLANDC__)
-#    define APIENTRY __stdcall
-#  else
-#    define APIENTRY
-#  endif
-#endif
-
-
-static shader* active = NULL;
-
-static const char* INTERNAL_NAME   = "G4L.Shader";
-static const char* UNIFORMS_NAME   = "G4L.Shader.uniforms";
-static const char* ATTRIBUTES_NAME = "G4L.Shader.attributes";
-
-static GLint get_location(lua_State*L, shader* s, const char* name,
-                          const char* registry,
-                          GLint (APIENTRY *getter)(GLuint, const GLchar*))
-{
-	lua_pushstring(L, registry);
-	lua_rawget(L, LUA_REGISTRYINDEX);
-	lua_pushinteger(L, s->id);
-	lua_rawget(L, -2);
+// program set with g4l.setShader() and program currently bound in GL. they
+// differ after setting uniforms without direct state access until the next
+// draw call restores the active one.
+static GLuint active_program = 0;
+static GLuint bound_program = 0;
 
-	lua_pushstring(L, name);
-	lua_rawget(L, -2);
+static const char* INTERNAL_NAME       = "G4L.Shader";
+static const char* UNIFORM_HANDLE_NAME = "G4L.Shader.uniform";
+static const char* VARIANTS_NAME       = "G4L.Shader.variants";
+static const char* FILES_NAME          = "G4L.Shader.files";
 
-	// known
-	if (!lua_isnil(L, -1))
-	{
-		int location = lua_tointeger(L, -1);
-		lua_pop(L, 3);
-		return location;
-	}
+// the uniform name is stored right behind the handle
+typedef struct
+{
+	shader*      s;
+	int          shader_ref;
+	GLuint       generation; // of the shader when info was resolved
+	uniforminfo  info;
+} uniformhandle;
 
-	// unknown: get and record it
-	int location = getter(s->id, name);
-	if (location == -1)
-	{
-		lua_pop(L, 3);
+static GLint get_attribute_location(lua_State* L, shader* s, const char* name)
+{
+	uniforminfo* a = uniformmap_get(&s->attributes, name);
+	if (NULL != a)
+		return a->location;
+
+	GLint location = glGetAttribLocation(s->id, name);
+	if (-1 == location)
 		return luaL_error(L, "`%s' not found. Maybe it's optimized out?", name);
+	return location;
+}
+
+// looks up uniform in the shader's uniform map. all active uniforms are
+// recorded at link time, so only array elements like `name[2]' need to be
+// resolved. they are recorded with the type of the array.
+static uniforminfo* get_uniform(lua_State* L, shader* s, const char* name)
+{
+	uniforminfo* u = uniformmap_get(&s->uniforms, name);
+	if (NULL != u)
+		return u;
+
+	GLint location = glGetUniformLocation(s->id, name);
+	if (-1 == location)
+		luaL_error(L, "`%s' not found. Maybe it's optimized out?", name);
+
+	GLenum type = 0;
+	const char* bracket = strchr(name, '[');
+	if (NULL != bracket)
+	{
+		lua_pushlstring(L, name, bracket - name);
+		uniforminfo* array = uniformmap_get(&s->uniforms, lua_tostring(L, -1));
+		lua_pop(L, 1);
+		if (NULL != array)
+			type = array->type;
 	}
 
-	lua_pushstring(L, name);
-	lua_pushinteger(L, location);
-	lua_rawset(L, -4);
-	lua_pop(L, 3);
-	return location;
+	u = uniformmap_insert(&s->uniforms, name);
+	if (NULL == u)
+		luaL_error(L, "Out of memory");
+
+	u->location = location;
+	u->type = type;
+	u->size = 1;
+	return u;
 }
 
-#define get_uniform_location(L, s, name) \
-	get_location(L, s, name, UNIFORMS_NAME, glGetUniformLocation)
-#define get_attribute_location(L, s, name) \
-	get_location(L, s, name, ATTRIBUTES_NAME, glGetAttribLocation)
+static void use_program(GLuint id)
+{
+	if (id == bound_program)
+		return;
+	glUseProgram(id);
+	bound_program = id;
+}
 
-shader* l_checkshader(lua_State* L, int idx)
+void shader_bind_active()
 {
-	return (shader*)luaL_checkudata(L, idx, INTERNAL_NAME);
+	use_program(active_program);
+}
+
+// binds the program if uniforms cannot be written to it directly
+static void prepare_uniforms(GLuint id)
+{
+	if (!uniform_direct_access())
+		use_program(id);
 }
 
 int l_shader_set(lua_State* L)
 {
-	shader* s = NULL;
 	if (lua_isnoneornil(L,1))
-	{
-		glUseProgram(0);
-	}
+		active_program = 0;
 	else
-	{
-		s = l_checkshader(L, 1);
-		glUseProgram(s->id);
-	}
-	active = s;
+		active_program = l_checkshader(L, 1)->id;
+	use_program(active_program);
 	return 0;
 }
 
@@ -138,6 +152,7 @@ static int l_shader_bindAttribute(lua_State* L)
 	int low             = luaL_optint(L, 5, 1);
 	int high            = luaL_optint(L, 6, stride);
 	GLboolean normalize = lua_toboolean(L, 7) ? GL_TRUE : GL_FALSE;
+	GLuint divisor      = luaL_optinteger(L, 8, 0);
 
 	GLint location      = get_attribute_location(L, s, name);
 
@@ -154,7 +169,26 @@ static int l_shader_bindAttribute(lua_State* L)
 	glBindBuffer(b->target, b->id);
 	glVertexAttribPointer(location, span, b->element_type, normalize,
 	                      b->element_size * stride,
-	                      (GLvoid*)((char*)NULL + b->element_size * (low-1)));
+	                      (GLvoid*)((char*)NULL + b->offset + b->element_size * (low-1)));
+	glVertexAttribDivisor(location, divisor);
+	if (stride > 0)
+		b->stride = stride;
+
+	lua_settop(L, 1);
+	return 1;
+}
+
+static int l_shader_bindBlock(lua_State* L)
+{
+	shader* s        = l_checkshader(L, 1);
+	const char* name = luaL_checkstring(L, 2);
+	GLuint binding   = luaL_checkinteger(L, 3);
+
+	GLuint block = glGetUniformBlockIndex(s->id, name);
+	if (GL_INVALID_INDEX == block)
+		return luaL_error(L, "Uniform block `%s' not found", name);
+
+	glUniformBlockBinding(s->id, block, binding);
 
 	lua_settop(L, 1);
 	return 1;
@@ -163,6 +197,14 @@ static int l_shader_bindAttribute(lua_State* L)
 static int l_shader___gc(lua_State* L)
 {
 	shader* s = (shader*)lua_touserdata(L, 1);
+	uniformmap_free(&s->uniforms);
+	uniformmap_free(&s->attributes);
+	for (int i = 0; i < 3; ++i)
+		glDeleteShader(s->stages[i]);
+	if (s->id == bound_program)
+		use_program(0);
+	if (s->id == active_program)
+		active_program = 0;
 	glDeleteProgram(s->id);
 	return 0;
 }
@@ -172,181 +214,374 @@ static int l_shader___index(lua_State* L)
 	luaL_getmetatable(L, INTERNAL_NAME);
 	lua_pushvalue(L, 2);
 	lua_rawget(L, -2);
-	if (!lua_isnil(L, 1))
+	if (!lua_isnil(L, -1))
 		return 1;
 
 	// get uniform value
-	shader* s = (shader*)lua_touserdata(L, 1);
+	shader* s = l_checkshader(L, 1);
 	const char* name = luaL_checkstring(L, 2);
-	GLint location = get_uniform_location(L, s, name);
-	// NaNNaNNaNNaNNaNNaNNaNNaNNaNNaNNaNNaNNaNNaNNaNNaN Batman!
-	GLfloat params[16] = {NAN};
-	glGetUniformfv(s->id, location, params);
+	uniforminfo* u = get_uniform(L, s, name);
+	if (!uniform_get(L, s->id, u))
+		return luaL_error(L, "Cannot read `%s': Unsupported type `%s'.",
+		                  name, uniform_type_name(u->type));
+	return 1;
+}
 
-	lua_createtable(L, 16, 0);
-	for (int i = 0; i < 16; ++i)
+// pushes table of name -> {type = glsl type, size = array size, location}
+static void push_info(lua_State* L, const uniformmap* m)
+{
+	lua_createtable(L, 0, m->count);
+	for (int i = 0; i < m->capacity; ++i)
 	{
-		lua_pushnumber(L, params[i]);
-		lua_rawseti(L, -2, i+1);
+		const uniforminfo* u = &m->slots[i];
+		if (NULL == u->name)
+			continue;
+
+		lua_createtable(L, 0, 3);
+		lua_pushstring(L, uniform_type_name(u->type));
+		lua_setfield(L, -2, "type");
+		lua_pushinteger(L, u->size);
+		lua_setfield(L, -2, "size");
+		lua_pushinteger(L, u->location);
+		lua_setfield(L, -2, "location");
+		lua_setfield(L, -2, u->name);
 	}
+}
+
+static int l_shader_uniforms(lua_State* L)
+{
+	shader* s = l_checkshader(L, 1);
+	push_info(L, &s->uniforms);
+	return 1;
+}
+
+static int l_shader_attributes(lua_State* L)
+{
+	shader* s = l_checkshader(L, 1);
+	push_info(L, &s->attributes);
 	return 1;
 }
 
 // set uniform value
 static int l_shader___newindex(lua_State* L)
 {
-	shader* s = (shader*)lua_touserdata(L, 1);
+	shader* s = l_checkshader(L, 1);
 	const char* name = luaL_checkstring(L, 2);
-	GLint location = get_uniform_location(L, s, name);
+	uniforminfo* u = get_uniform(L, s, name);
 
-	glUseProgram(s->id);
+	prepare_uniforms(s->id);
+	int ok = uniform_set(L, s->id, u, 3);
+
+	if (!ok)
+		return luaL_error(L, "Cannot set value %s: Unknown type `%s'.",
+		                  name, lua_typename(L, lua_type(L, 3)));
+	return 0;
+}
 
-	if (lua_isnumber(L, 3))
+// set several uniforms at once: shader:set{name = value, ...}
+static int l_shader_setUniforms(lua_State* L)
+{
+	shader* s = l_checkshader(L, 1);
+	luaL_checktype(L, 2, LUA_TTABLE);
+	lua_settop(L, 2);
+
+	prepare_uniforms(s->id);
+	lua_pushnil(L);
+	while (lua_next(L, 2))
 	{
-		glUniform1f(location, lua_tonumber(L, 3));
+		if (LUA_TSTRING != lua_type(L, -2))
+			return luaL_error(L, "Invalid uniform name: string expected, got %s",
+			                  luaL_typename(L, -2));
+
+		const char* name = lua_tostring(L, -2);
+		if (!uniform_set(L, s->id, get_uniform(L, s, name), 4))
+			return luaL_error(L, "Cannot set value %s: Unknown type `%s'.",
+			                  name, lua_typename(L, lua_type(L, 4)));
+		lua_pop(L, 1);
 	}
-	else if (l_isanyvec(L, 3))
+
+	lua_settop(L, 1);
+	return 1;
+}
+
+static int l_uniform_set(lua_State* L)
+{
+	uniformhandle* h = (uniformhandle*)luaL_checkudata(L, 1, UNIFORM_HANDLE_NAME);
+
+	// the shader was reloaded: resolve again
+	if (h->generation != h->s->generation)
 	{
-		vec4* v = (vec4*)lua_touserdata(L, 3);
-		switch (v->dim)
-		{
-		case 2:
-			glUniform2fv(location, 1, v->v);
-			break;
-		case 3:
-			glUniform3fv(location, 1, v->v);
-			break;
-		case 4:
-			glUniform4fv(location, 1, v->v);
-			break;
-		}
+		char* name = h->info.name;
+		h->info = *get_uniform(L, h->s, name);
+		h->info.name = name;
+		h->generation = h->s->generation;
 	}
-	else if (l_isanymat(L, 3))
+
+	prepare_uniforms(h->s->id);
+	int ok = uniform_set(L, h->s->id, &h->info, 2);
+
+	if (!ok)
+		return luaL_error(L, "Cannot set value: Unknown type `%s'.",
+		                  lua_typename(L, lua_type(L, 2)));
+
+	lua_settop(L, 1);
+	return 1;
+}
+
+static int l_uniform___gc(lua_State* L)
+{
+	uniformhandle* h = (uniformhandle*)lua_touserdata(L, 1);
+	luaL_unref(L, LUA_REGISTRYINDEX, h->shader_ref);
+	return 0;
+}
+
+// returns a handle to a resolved uniform. setting values through the handle
+// skips the name lookup.
+static int l_shader_uniform(lua_State* L)
+{
+	shader* s = l_checkshader(L, 1);
+	const char* name = luaL_checkstring(L, 2);
+	uniforminfo* u = get_uniform(L, s, name);
+
+	size_t len = strlen(name);
+	uniformhandle* h = (uniformhandle*)lua_newuserdata(L, sizeof(uniformhandle) + len + 1);
+	h->s = s;
+	h->generation = s->generation;
+	h->info = *u;
+	h->info.name = (char*)(h + 1);
+	memcpy(h->info.name, name, len + 1);
+
+	// keep the shader alive as long as the handle
+	lua_pushvalue(L, 1);
+	h->shader_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+	if (luaL_newmetatable(L, UNIFORM_HANDLE_NAME))
 	{
-		mat44* m = (mat44*)lua_touserdata(L, 3);
-		switch (m->rows)
+		luaL_reg meta[] =
 		{
-		case 2:
-			glUniformMatrix2fv(location, 1, GL_TRUE, m->m);
-			break;
-		case 3:
-			glUniformMatrix3fv(location, 1, GL_TRUE, m->m);
-			break;
-		case 4:
-			glUniformMatrix4fv(location, 1, GL_TRUE, m->m);
-			break;
-		}
-	}
-	else if (l_istexture(L, 3))
-	{
-		texture* tex = (texture*)lua_touserdata(L, 3);
-		texture_bind(tex);
-		glUniform1i(location, tex->unit);
-	}
-	else
-	{
-		if (NULL != active)
-			glUseProgram(active->id);
-		return luaL_error(L, "Cannot set value %s: Unknown type `%s'.",
-		                  name, lua_typename(L, lua_type(L, 3)));
+			{"__gc", l_uniform___gc},
+			{"set",  l_uniform_set},
+			{NULL, NULL}
+		};
+		l_registerFunctions(L, -1, meta);
+		lua_pushvalue(L, -1);
+		lua_setfield(L, -1, "__index");
 	}
+	lua_setmetatable(L, -2);
 
-	if (NULL != active)
-		glUseProgram(active->id);
-	return 0;
+	return 1;
 }
 
-static int l_shader_warnings(lua_State* L)
+static void push_shader_log(lua_State* L, GLuint id)
 {
-	shader* s = (shader*)lua_touserdata(L, 1);
+	GLint len = 0;
+	glGetShaderiv(id, GL_INFO_LOG_LENGTH, &len);
+	char* log = (char*)malloc(len+1);
+	glGetShaderInfoLog(id, len, NULL, log);
+	lua_pushlstring(L, log, len);
+	free(log);
+}
 
+static void push_program_log(lua_State* L, GLuint id)
+{
 	GLint len = 0;
-	glGetProgramiv(s->id, GL_INFO_LOG_LENGTH, &len);
+	glGetProgramiv(id, GL_INFO_LOG_LENGTH, &len);
 	char* log = (char*)malloc(len+1);
-	glGetProgramInfoLog(s->id, len, NULL, log);
+	glGetProgramInfoLog(id, len, NULL, log);
 	lua_pushlstring(L, log, len);
 	free(log);
+}
 
+static int l_shader_warnings(lua_State* L)
+{
+	shader* s = (shader*)lua_touserdata(L, 1);
+	push_program_log(L, s->id);
 	return 1;
 }
 
-int l_shader_new(lua_State* L)
+static GLuint compile_stage(GLenum type, const char* source)
 {
-	if (!context_available())
-		return luaL_error(L, "No OpenGL context available. Create a window first.");
-	if (!lua_isstring(L, 1))
-		return luaL_typerror(L, 1, "Vertex shader code");
-	if (!lua_isstring(L, 2))
-		return luaL_typerror(L, 2, "Fragment shader code");
-
-	const char* vs_source = lua_tostring(L, 1);
-	const char* fs_source = lua_tostring(L, 2);
+	GLuint id = glCreateShader(type);
+	glShaderSource(id, 1, &source, NULL);
+	glCompileShader(id);
+	return id;
+}
 
-	GLint status = GL_FALSE;
+static const GLenum STAGE_TYPES[3] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER};
+static const char* STAGE_NAMES[3]  = {"vertex", "fragment", "geometry"};
 
-	GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vs, 1, &vs_source, NULL);
-	glCompileShader(vs);
-	glGetShaderiv(vs, GL_COMPILE_STATUS, &status);
-	if (!status)
+// issues compilation and linking without waiting for the results, so the
+// driver may work on several programs at once. `sources' are vertex,
+// fragment and geometry shader. the latter two may be NULL. the varyings
+// are read from the table at `varyings' (0 if none).
+static void start_program(lua_State* L, shader* s, const char* sources[3],
+                          int varyings, GLenum mode)
+{
+	int count = (0 != varyings) ? (int)lua_objlen(L, varyings) : 0;
+	for (int i = 1; i <= count; ++i)
 	{
-		GLint len = 0;
-		glGetShaderiv(vs, GL_INFO_LOG_LENGTH, &len);
-		char* log = (char*)malloc(len+1);
-		glGetShaderInfoLog(vs, len, NULL, log);
-		lua_pushlstring(L, log, len);
-		free(log);
+		lua_rawgeti(L, varyings, i);
+		if (LUA_TSTRING != lua_type(L, -1))
+			luaL_error(L, "Invalid varying #%d: string expected, got %s",
+			           i, luaL_typename(L, -1));
+		lua_pop(L, 1);
+	}
 
-		glDeleteShader(vs);
-		return luaL_error(L, "Cannot compile vertex shader:\n%s", lua_tostring(L, -1));
+	for (int i = 0; i < 3; ++i)
+	{
+		s->stages[i] = (NULL != sources[i]) ? compile_stage(STAGE_TYPES[i], sources[i]) : 0;
+		if (0 != s->stages[i])
+			glAttachShader(s->id, s->stages[i]);
 	}
+	s->pending = 1;
 
-	GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fs, 1, &fs_source, NULL);
-	glCompileShader(fs);
-	glGetShaderiv(fs, GL_COMPILE_STATUS, &status);
-	if (!status)
+	if (0 != varyings)
 	{
+		const char** names = (const char**)malloc((count + 1) * sizeof(const char*));
+		if (NULL == names)
+			luaL_error(L, "Out of memory");
+
+		for (int i = 0; i < count; ++i)
+		{
+			lua_rawgeti(L, varyings, i+1);
+			names[i] = lua_tostring(L, -1); // still referenced by the table
+			lua_pop(L, 1);
+		}
+		glTransformFeedbackVaryings(s->id, count, names, mode);
+		free(names);
+	}
+
+	if (programcache_enabled())
+		glProgramParameteri(s->id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 
-		GLint len = 0;
-		glGetShaderiv(fs, GL_INFO_LOG_LENGTH, &len);
-		char* log = (char*)malloc(len+1);
-		glGetShaderInfoLog(fs, len, NULL, log);
-		lua_pushlstring(L, log, len);
-		free(log);
+	glLinkProgram(s->id);
+}
 
-		glDeleteShader(fs);
-		glDeleteShader(vs);
+// waits for compilation and linking. returns 1 on success. on failure, the
+// error message is pushed and 0 returned. the stages are kept until the
+// shader is collected, so the check can be repeated.
+static int finish_program(lua_State* L, shader* s)
+{
+	if (!s->pending)
+		return 1;
+
+	GLint status = GL_FALSE;
+	for (int i = 0; i < 3; ++i)
+	{
+		if (0 == s->stages[i])
+			continue;
 
-		return luaL_error(L, "Cannot compile fragment shader:\n%s", lua_tostring(L, -1));
+		glGetShaderiv(s->stages[i], GL_COMPILE_STATUS, &status);
+		if (!status)
+		{
+			push_shader_log(L, s->stages[i]);
+			lua_pushfstring(L, "Cannot compile %s shader:\n%s", STAGE_NAMES[i], lua_tostring(L, -1));
+			lua_remove(L, -2);
+			return 0;
+		}
 	}
 
-	GLuint program = glCreateProgram();
-	glAttachShader(program, vs);
-	glAttachShader(program, fs);
-	glLinkProgram(program);
-	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	glGetProgramiv(s->id, GL_LINK_STATUS, &status);
 	if (!status)
 	{
-		GLint len = 0;
-		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &len);
-		char* log = (char*)malloc(len+1);
-		glGetProgramInfoLog(program, len, NULL, log);
-		lua_pushlstring(L, log, len);
-		free(log);
+		push_program_log(L, s->id);
+		lua_pushfstring(L, "Cannot link shader:\n%s", lua_tostring(L, -1));
+		lua_remove(L, -2);
+		return 0;
+	}
+
+	if (programcache_enabled())
+		programcache_store(s->key, s->id);
+
+	uniform_introspect(&s->uniforms, &s->attributes, s->id);
+	for (int i = 0; i < 3; ++i)
+	{
+		glDeleteShader(s->stages[i]);
+		s->stages[i] = 0;
+	}
+	s->pending = 0;
+	return 1;
+}
+
+// pending programs are finished before they are used
+shader* l_checkshader(lua_State* L, int idx)
+{
+	shader* s = (shader*)luaL_checkudata(L, idx, INTERNAL_NAME);
+	if (!finish_program(L, s))
+		lua_error(L);
+	return s;
+}
+
+static int is_complete(shader* s)
+{
+	if (!s->pending)
+		return 1;
 
-		glDeleteProgram(program);
-		glDeleteShader(fs);
-		glDeleteShader(vs);
+	if (!GLEW_KHR_parallel_shader_compile && !GLEW_ARB_parallel_shader_compile)
+		return 1;
+
+	GLint done = GL_TRUE;
+	glGetProgramiv(s->id, GL_COMPLETION_STATUS_KHR, &done);
+	return done;
+}
 
-		return luaL_error(L, "Cannot link shader:\n%s", lua_tostring(L, -1));
+// returns true once the shader can be used without blocking. raises an
+// error if compiling or linking failed.
+static int l_shader_isReady(lua_State* L)
+{
+	shader* s = (shader*)luaL_checkudata(L, 1, INTERNAL_NAME);
+	if (!is_complete(s))
+	{
+		lua_pushboolean(L, 0);
+		return 1;
 	}
 
-	glDeleteShader(fs);
-	glDeleteShader(vs);
+	if (!finish_program(L, s))
+		return lua_error(L);
 
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+// hashes everything that goes into the program
+static programkey program_key(lua_State* L, const char* sources[3], int varyings, GLenum mode)
+{
+	programkey k = programcache_begin();
+	for (int i = 0; i < 3; ++i)
+	{
+		if (NULL != sources[i])
+			k = programcache_feed(k, sources[i], strlen(sources[i]) + 1);
+		else
+			k = programcache_feed(k, "", 1);
+	}
+
+	if (0 == varyings)
+		return k;
+
+	k = programcache_feed(k, &mode, sizeof(mode));
+	for (int i = 1; i <= (int)lua_objlen(L, varyings); ++i)
+	{
+		lua_rawgeti(L, varyings, i);
+		size_t len;
+		const char* name = lua_tolstring(L, -1, &len);
+		if (NULL != name)
+			k = programcache_feed(k, name, len + 1);
+		lua_pop(L, 1);
+	}
+	return k;
+}
+
+// pushes a shader without program
+static shader* new_shader(lua_State* L)
+{
 	shader* s = (shader*)lua_newuserdata(L, sizeof(shader));
-	s->id = program;
+	s->id = 0;
+	s->stages[0] = s->stages[1] = s->stages[2] = 0;
+	s->pending = 0;
+	s->key = 0;
+	s->generation = 0;
+	uniformmap_init(&s->uniforms);
+	uniformmap_init(&s->attributes);
 
 	if (luaL_newmetatable(L, INTERNAL_NAME))
 	{
@@ -356,29 +591,456 @@ int l_shader_new(lua_State* L)
 			{"__index",    l_shader___index},
 			{"__newindex", l_shader___newindex},
 			{"warnings",   l_shader_warnings},
+			{"uniform",    l_shader_uniform},
+			{"set",        l_shader_setUniforms},
+			{"uniforms",   l_shader_uniforms},
+			{"attributes", l_shader_attributes},
+			{"isReady",    l_shader_isReady},
 
 			// attribute handling
 			{"enableAttribute",   l_shader_enableAttribute},
 			{"disableAttribute",  l_shader_disableAttribute},
 			{"bindAttribute",     l_shader_bindAttribute},
 
+			// uniform blocks
+			{"bindBlock",         l_shader_bindBlock},
+
 			{NULL, NULL}
 		};
 		l_registerFunctions(L, -1, meta);
 	}
 	lua_setmetatable(L, -2);
+	return s;
+}
 
-	// create uniform registry
-	luaL_newmetatable(L, UNIFORMS_NAME);
-	lua_newtable(L);
-	lua_rawseti(L, -2, s->id);
+// pushes shader for arguments (vs, fs, [gs], [varyings, [mode]]) at `idx'.
+// the program is loaded from the cache or started, but not checked.
+static shader* push_shader(lua_State* L, int idx)
+{
+	if (!lua_isstring(L, idx))
+		luaL_typerror(L, idx, "Vertex shader code");
+
+	int gs = (LUA_TSTRING == lua_type(L, idx+2)) ? idx+2 : 0;
+	int varyings = (0 != gs) ? idx+3 : idx+2;
+	if (!lua_istable(L, varyings))
+		varyings = 0;
+
+	// transform feedback: no fragment shader needed
+	if (!lua_isstring(L, idx+1) && !(0 != varyings && lua_isnil(L, idx+1)))
+		luaL_typerror(L, idx+1, "Fragment shader code");
+
+	// resolve #include
+	int stages[3] = {idx, lua_isstring(L, idx+1) ? idx+1 : 0, gs};
+	const char* sources[3] = {NULL, NULL, NULL};
+	for (int i = 0; i < 3; ++i)
+	{
+		if (0 == stages[i])
+			continue;
+		preprocess(L, stages[i], 0);
+		lua_replace(L, stages[i]);
+		sources[i] = lua_tostring(L, stages[i]);
+	}
+
+	GLenum mode = (0 != varyings) ? luaL_optinteger(L, varyings+1, GL_INTERLEAVED_ATTRIBS) : 0;
+
+	shader* s = new_shader(L);
+
+	if (programcache_enabled())
+	{
+		s->key = program_key(L, sources, varyings, mode);
+		s->id = programcache_load(s->key);
+		if (0 != s->id)
+			uniform_introspect(&s->uniforms, &s->attributes, s->id);
+	}
+
+	if (0 == s->id)
+	{
+		s->id = glCreateProgram();
+		start_program(L, s, sources, varyings, mode);
+	}
+
+	return s;
+}
+
+int l_shader_new(lua_State* L)
+{
+	if (!context_available())
+		return luaL_error(L, "No OpenGL context available. Create a window first.");
+
+	shader* s = push_shader(L, 1);
+	if (!finish_program(L, s))
+		return lua_error(L);
+
+	return 1;
+}
+
+// pushes a string that identifies the preprocessed program arguments
+// (vs, fs, [gs], [varyings, [mode]]) at 1-5
+static void push_variant_key(lua_State* L)
+{
+	int varyings = (LUA_TSTRING == lua_type(L, 3)) ? 4 : 3;
+
+	luaL_Buffer b;
+	luaL_buffinit(L, &b);
+	for (int i = 1; i < varyings; ++i)
+	{
+		if (lua_isstring(L, i))
+		{
+			lua_pushvalue(L, i);
+			luaL_addvalue(&b);
+		}
+		luaL_addchar(&b, '\0');
+	}
+	if (3 == varyings)
+		luaL_addchar(&b, '\0');
+
+	if (!lua_istable(L, varyings))
+	{
+		luaL_pushresult(&b);
+		return;
+	}
+
+	for (int i = 1; i <= (int)lua_objlen(L, varyings); ++i)
+	{
+		lua_rawgeti(L, varyings, i);
+		if (lua_isstring(L, -1))
+			luaL_addvalue(&b);
+		else
+			lua_pop(L, 1);
+		luaL_addchar(&b, '\0');
+	}
+	lua_pushinteger(L, luaL_optinteger(L, varyings+1, GL_INTERLEAVED_ATTRIBS));
+	luaL_addvalue(&b);
+	luaL_pushresult(&b);
+}
+
+// like g4l.shader(), but with definitions injected into all sources.
+// requesting the same variant again returns the existing shader.
+int l_shader_variant(lua_State* L)
+{
+	if (!context_available())
+		return luaL_error(L, "No OpenGL context available. Create a window first.");
+
+	luaL_checkstring(L, 1);
+	luaL_checktype(L, 3, LUA_TTABLE);
+
+	// vertex, fragment and geometry shader
+	int stages[3] = {1, 2, 4};
+	for (int i = 0; i < 3; ++i)
+	{
+		if (LUA_TSTRING != lua_type(L, stages[i]))
+			continue;
+		preprocess(L, stages[i], 3);
+		lua_replace(L, stages[i]);
+	}
+	lua_remove(L, 3);
+	lua_settop(L, 5);
+
+	push_variant_key(L);
+	if (luaL_newmetatable(L, VARIANTS_NAME))
+	{
+		// shaders are only cached as long as they are used
+		lua_pushstring(L, "v");
+		lua_setfield(L, -2, "__mode");
+		lua_pushvalue(L, -1);
+		lua_setmetatable(L, -2);
+	}
+
+	lua_pushvalue(L, 6);
+	lua_rawget(L, 7);
+	if (!lua_isnil(L, -1))
+		return 1;
 	lua_pop(L, 1);
 
-	// create attribute registry
-	luaL_newmetatable(L, ATTRIBUTES_NAME);
+	shader* s = push_shader(L, 1);
+	if (!finish_program(L, s))
+		return lua_error(L);
+
+	lua_pushvalue(L, 6);
+	lua_pushvalue(L, -2);
+	lua_rawset(L, 7);
+	return 1;
+}
+
+// compiles a list of {vs, fs, [gs], [varyings, [mode]]} at once. unless `wait' is
+// false, returns a list of shaders and a list of errors. failed shaders
+// are false in the first list.
+// creates a shader from the arguments at 1..5. called protected by
+// g4l.shaders(), so a broken entry does not abort the whole batch.
+static int push_batch_shader(lua_State* L)
+{
+	push_shader(L, 1);
+	return 1;
+}
+
+// records the message on top of the stack as the error of batch entry `i'
+static void batch_failed(lua_State* L, int i)
+{
+	lua_rawseti(L, 3, i);
+	lua_pushboolean(L, 0);
+	lua_rawseti(L, 2, i);
+}
+
+int l_shader_new_batch(lua_State* L)
+{
+	if (!context_available())
+		return luaL_error(L, "No OpenGL context available. Create a window first.");
+
+	luaL_checktype(L, 1, LUA_TTABLE);
+	int wait = lua_isnoneornil(L, 2) || lua_toboolean(L, 2);
+	lua_settop(L, 1);
+
+	if (GLEW_KHR_parallel_shader_compile)
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+	else if (GLEW_ARB_parallel_shader_compile)
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+
+	int count = lua_objlen(L, 1);
+	lua_createtable(L, count, 0);
 	lua_newtable(L);
-	lua_rawseti(L, -2, s->id);
+	for (int i = 1; i <= count; ++i)
+	{
+		lua_rawgeti(L, 1, i);
+		if (!lua_istable(L, -1))
+		{
+			lua_pushfstring(L, "Invalid shader #%d: table expected, got %s",
+			                i, luaL_typename(L, -1));
+			batch_failed(L, i);
+			lua_settop(L, 3);
+			continue;
+		}
+
+		lua_pushcfunction(L, push_batch_shader);
+		for (int k = 1; k <= 5; ++k)
+			lua_rawgeti(L, 4, k);
+		if (0 != lua_pcall(L, 5, 1, 0))
+			batch_failed(L, i);
+		else
+			lua_rawseti(L, 2, i);
+		lua_settop(L, 3);
+	}
+
+	if (!wait)
+		return 2;
+
+	// all programs are issued: collect results
+	for (int i = 1; i <= count; ++i)
+	{
+		lua_rawgeti(L, 2, i);
+		if (lua_isuserdata(L, -1) && !finish_program(L, (shader*)lua_touserdata(L, -1)))
+			batch_failed(L, i);
+		lua_settop(L, 3);
+	}
+	return 2;
+}
+
+//// HOT RELOADING ////
+static void push_source(lua_State* L, const char* path)
+{
+	int found = preprocessor_read(L, path);
+	if (0 == found)
+		luaL_error(L, "Cannot open `%s' for reading", path);
+	if (found < 0)
+		luaL_error(L, "Cannot read `%s'", path);
+}
+
+// keeps the attribute locations of program `from' in `to', so that vertex
+// arrays and bound attributes stay valid. call before linking `to'.
+static void bind_attribute_locations(GLuint from, GLuint to)
+{
+	GLint count = 0, maxlen = 0;
+	glGetProgramiv(from, GL_ACTIVE_ATTRIBUTES, &count);
+	glGetProgramiv(from, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxlen);
+
+	char* name = (char*)malloc(maxlen + 1);
+	if (NULL == name)
+		return;
+
+	for (GLint i = 0; i < count; ++i)
+	{
+		GLint size;
+		GLenum type;
+		glGetActiveAttrib(from, i, maxlen + 1, NULL, &size, &type, name);
+		if (0 == strncmp(name, "gl_", 3))
+			continue;
+
+		GLint location = glGetAttribLocation(from, name);
+		if (location >= 0)
+			glBindAttribLocation(to, location, name);
+	}
+	free(name);
+}
+
+static const char* STAGE_FILES[3] = {"vs", "fs", "gs"};
+static const char* STAGE_KEYS[3]  = {"vs_key", "fs_key", "gs_key"};
+
+// starts compiling the files of the entry at `entry' into a new program.
+// the old program stays in use until the new one is linked.
+static void start_reload(lua_State* L, shader* s, int entry)
+{
+	int top = lua_gettop(L);
+	const char* sources[3] = {NULL, NULL, NULL};
+	for (int i = 0; i < 3; ++i)
+	{
+		lua_getfield(L, entry, STAGE_FILES[i]);
+		if (lua_isnil(L, -1))
+			continue;
+
+		push_source(L, lua_tostring(L, -1));
+		preprocess(L, lua_gettop(L), 0);
+		sources[i] = lua_tostring(L, -1);
+	}
+
+	shader* t = new_shader(L);
+	if (programcache_enabled())
+		t->key = program_key(L, sources, 0, 0);
+	t->id = glCreateProgram();
+	bind_attribute_locations(s->id, t->id);
+	start_program(L, t, sources, 0, 0);
+
+	// replaces an older reload that is still compiling
+	lua_setfield(L, entry, "pending");
+	lua_settop(L, top);
+}
+
+// moves the program of `t' into `s' and gives `t' the old program
+static void swap_program(shader* s, shader* t)
+{
+	prepare_uniforms(t->id);
+	uniform_copy(s->id, t->id);
+
+	GLuint old = s->id;
+	s->id = t->id;
+	t->id = old;
+	if (old == active_program)
+		active_program = s->id;
+	if (old == bound_program)
+		use_program(s->id);
+
+	// the old locations go with the old program
+	uniformmap m = s->uniforms;
+	s->uniforms = t->uniforms;
+	t->uniforms = m;
+	m = s->attributes;
+	s->attributes = t->attributes;
+	t->attributes = m;
+	++s->generation;
+}
+
+static void finish_reload(lua_State* L, shader* s, int entry)
+{
+	lua_getfield(L, entry, "pending");
+	shader* t = (shader*)lua_touserdata(L, -1);
+	if (NULL == t || !is_complete(t))
+	{
+		lua_pop(L, 1);
+		return;
+	}
+
+	if (finish_program(L, t))
+	{
+		swap_program(s, t);
+	}
+	else
+	{
+		// keep the old program
+		lua_getfield(L, entry, "vs");
+		fprintf(stderr, "Cannot reload shader `%s': %s\n",
+		        lua_tostring(L, -1), lua_tostring(L, -2));
+		lua_pop(L, 2);
+	}
+
 	lua_pop(L, 1);
+	lua_pushnil(L);
+	lua_setfield(L, entry, "pending");
+}
+
+static int reload_files(lua_State* L)
+{
+	int changed = filewatch_poll(L) ? lua_gettop(L) : 0;
+
+	lua_getfield(L, LUA_REGISTRYINDEX, FILES_NAME);
+	if (!lua_istable(L, -1))
+		return 0;
+	int files = lua_gettop(L);
+
+	lua_pushnil(L);
+	while (lua_next(L, files))
+	{
+		int entry = lua_gettop(L);
+		shader* s = (shader*)lua_touserdata(L, entry - 1);
+
+		if (0 != changed)
+		{
+			int modified = 0;
+			for (int i = 0; i < 3; ++i)
+			{
+				lua_getfield(L, entry, STAGE_KEYS[i]);
+				lua_rawget(L, changed);
+				modified = modified || lua_toboolean(L, -1);
+				lua_pop(L, 1);
+			}
+
+			if (modified)
+				start_reload(L, s, entry);
+		}
+
+		finish_reload(L, s, entry);
+		lua_settop(L, entry - 1);
+	}
+	return 0;
+}
+
+// called from the main loop. errors are reported, but do not stop the
+// program.
+void shader_reload_files(lua_State* L)
+{
+	lua_pushcfunction(L, reload_files);
+	if (0 != lua_pcall(L, 0, 0, 0))
+	{
+		fprintf(stderr, "Cannot reload shader: %s\n", lua_tostring(L, -1));
+		lua_pop(L, 1);
+	}
+}
+
+// shader that is recompiled whenever one of its files changes. uniform
+// values are kept.
+int l_shader_file(lua_State* L)
+{
+	if (!context_available())
+		return luaL_error(L, "No OpenGL context available. Create a window first.");
+
+	luaL_checkstring(L, 1);
+	luaL_checkstring(L, 2);
+	int stages = lua_isnoneornil(L, 3) ? 2 : 3;
+	lua_settop(L, stages);
+
+	for (int i = 1; i <= stages; ++i)
+		push_source(L, luaL_checkstring(L, i));
+	int shader_idx = 2 * stages + 1;
+	shader* s = push_shader(L, stages + 1);
+	if (!finish_program(L, s))
+		return lua_error(L);
+
+	if (luaL_newmetatable(L, FILES_NAME))
+	{
+		lua_pushstring(L, "k");
+		lua_setfield(L, -2, "__mode");
+		lua_pushvalue(L, -1);
+		lua_setmetatable(L, -2);
+	}
+
+	lua_pushvalue(L, shader_idx);
+	lua_createtable(L, 0, 7);
+	for (int i = 0; i < stages; ++i)
+	{
+		lua_pushvalue(L, i+1);
+		lua_setfield(L, -2, STAGE_FILES[i]);
+		filewatch_add(L, lua_tostring(L, i+1));
+		lua_setfield(L, -2, STAGE_KEYS[i]);
+	}
+	lua_rawset(L, -3);
 
+	lua_settop(L, shader_idx);
 	return 1;
 }
@@ -2,16 +2,33 @@
 #define __G4L_SHADER_H
 
 #include <glew.h>
+#include "uniform.h"
+#include "programcache.h"
 
 struct lua_State;
 
 typedef struct shader
 {
-	GLuint id;
+	GLuint     id;
+	GLuint     stages[3]; // vertex, fragment and geometry shader until linked
+	int        pending;   // link status not checked yet
+	programkey key;
+	uniformmap uniforms;
+	uniformmap attributes;
+	GLuint     generation; // incremented when the program is replaced
 } shader;
 
 shader* l_checkshader(struct lua_State* L, int idx);
 int l_shader_new(struct lua_State* L);
+int l_shader_new_batch(struct lua_State* L);
+int l_shader_variant(struct lua_State* L);
+int l_shader_file(struct lua_State* L);
 int l_shader_set(struct lua_State* L);
 
+// rebinds the program set by g4l.setShader(). call before drawing.
+void shader_bind_active();
+
+// recompiles shaders created with g4l.shaderFile() whose files changed
+void shader_reload_files(struct lua_State* L);
+
 #endif
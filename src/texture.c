@@ -5,11 +5,90 @@
 #include <lua.h>
 #include <lauxlib.h>
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
 static const char* INTERNAL_NAME = "G4L.texture";
 static int unit_max = 0;
 
+// shadow of the texture bound to each unit. the binding is only changed by
+// this module, so redundant binds can be skipped.
+static GLuint* bindings = NULL;
+static GLuint active_unit = 0;
+static unsigned int binds_issued = 0;
+static unsigned int binds_skipped = 0;
+
+// pixel unpack buffers for asynchronous uploads. each buffer is fenced
+// after its upload and reused once the GPU is done with it.
+#define UPLOAD_BUFFERS 3
+typedef struct
+{
+	GLuint     id;
+	GLsizeiptr size;
+	GLsync     fence;
+} uploadbuffer;
+static uploadbuffer uploads[UPLOAD_BUFFERS];
+static int upload_next = 0;
+
+static void init_bindings(lua_State* L)
+{
+	if (NULL != bindings)
+		return;
+
+	glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &unit_max);
+	bindings = (GLuint*)calloc(unit_max, sizeof(GLuint));
+	if (NULL == bindings)
+		luaL_error(L, "Out of memory");
+	glActiveTexture(GL_TEXTURE0);
+}
+
+// image rows are tightly packed, but GL expects rows to start at 4 byte
+// boundaries by default, which rows of one and two channel images do not.
+// every upload from an image is wrapped in begin_unpack()/end_unpack().
+// uploads read from client memory, so no unpack buffer may be bound.
+static void begin_unpack(void)
+{
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+}
+
+static void end_unpack(void)
+{
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+static void select_unit(GLuint unit)
+{
+	if (unit == active_unit)
+		return;
+	glActiveTexture(GL_TEXTURE0 + unit);
+	active_unit = unit;
+}
+
+// binds for sampling. the active unit is left alone if the texture is
+// already bound.
+static void bind_texture(GLuint unit, GLuint id)
+{
+	if (id == bindings[unit])
+	{
+		++binds_skipped;
+		return;
+	}
+
+	select_unit(unit);
+	glBindTexture(GL_TEXTURE_2D, id);
+	bindings[unit] = id;
+	++binds_issued;
+}
+
+// binds for editing: parameter and upload calls that follow go to `tex',
+// even if the bind itself is skipped
+static void edit_texture(texture* tex)
+{
+	select_unit(tex->unit);
+	bind_texture(tex->unit, tex->id);
+}
+
 texture* l_checktexture(lua_State* L, int idx)
 {
 	return (texture*)luaL_checkudata(L, idx, INTERNAL_NAME);
@@ -43,6 +122,10 @@ static int l_texture___index(lua_State* L)
 	{
 		lua_pushinteger(L, tex->unit);
 	}
+	else if (0 == strcmp(key, "format"))
+	{
+		lua_pushinteger(L, tex->format->internal);
+	}
 	else
 	{
 		lua_pushnil(L);
@@ -73,17 +156,39 @@ static int l_texture___newindex(lua_State* L)
 	return 0;
 }
 
+static int uses_mipmaps(GLenum min_filter)
+{
+	return GL_NEAREST != min_filter && GL_LINEAR != min_filter;
+}
+
+static void update_mipmaps(texture* tex)
+{
+	if (!tex->mipmaps)
+		return;
+	edit_texture(tex);
+	glGenerateMipmap(GL_TEXTURE_2D);
+}
+
 static int l_texture_filter(lua_State* L)
 {
 	texture* tex = l_checktexture(L, 1);
 	GLenum mag_filter = luaL_checkinteger(L, 2);
 	GLenum min_filter = luaL_optinteger(L, 3, mag_filter);
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, tex->id);
+	// mipmap filters are only valid for minification
+	if (uses_mipmaps(mag_filter))
+		return luaL_error(L, "Invalid magnification filter: %d", mag_filter);
+
+	edit_texture(tex);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mag_filter);
 
+	// a mipmapped filter on a texture without mipmaps samples black
+	int mipmaps = uses_mipmaps(min_filter);
+	if (mipmaps && !tex->mipmaps)
+		glGenerateMipmap(GL_TEXTURE_2D);
+	tex->mipmaps = mipmaps;
+
 	lua_settop(L, 1);
 	return 1;
 }
@@ -94,8 +199,7 @@ static int l_texture_wrap(lua_State* L)
 	GLenum wrap_s = luaL_checkinteger(L, 2);
 	GLenum wrap_t = luaL_optinteger(L, 3, wrap_s);
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, tex->id);
+	edit_texture(tex);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap_s);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap_t);
 
@@ -103,15 +207,230 @@ static int l_texture_wrap(lua_State* L)
 	return 1;
 }
 
+static int l_texture_generateMipmaps(lua_State* L)
+{
+	texture* tex = l_checktexture(L, 1);
+	edit_texture(tex);
+	glGenerateMipmap(GL_TEXTURE_2D);
+
+	lua_settop(L, 1);
+	return 1;
+}
+
+// bias is added to the level of detail before sampling, which is clamped
+// to [min, max]
+static int l_texture_lod(lua_State* L)
+{
+	texture* tex = l_checktexture(L, 1);
+	GLfloat bias = luaL_checknumber(L, 2);
+	GLfloat min_lod = luaL_optnumber(L, 3, -1000);
+	GLfloat max_lod = luaL_optnumber(L, 4, 1000);
+
+	edit_texture(tex);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_LOD_BIAS, bias);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, min_lod);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_LOD, max_lod);
+
+	lua_settop(L, 1);
+	return 1;
+}
+
+// returns the degree of anisotropy that is actually used
+static int l_texture_anisotropy(lua_State* L)
+{
+	texture* tex = l_checktexture(L, 1);
+	GLfloat degree = luaL_checknumber(L, 2);
+
+	if (!GLEW_EXT_texture_filter_anisotropic && !GLEW_ARB_texture_filter_anisotropic)
+	{
+		lua_pushnumber(L, 1);
+		return 1;
+	}
+
+	GLfloat max_degree = 1;
+	glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max_degree);
+	if (degree < 1)
+		degree = 1;
+	else if (degree > max_degree)
+		degree = max_degree;
+
+	edit_texture(tex);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, degree);
+
+	lua_pushnumber(L, degree);
+	return 1;
+}
+
+typedef struct
+{
+	GLint x, y;
+	GLsizei width, height;
+} rect;
+
+// reads the update arguments (image, x, y, [{x, y, w, h}]) at 2-5 and
+// checks that the source rect is in the image and the target in the texture
+static rect check_update(lua_State* L, texture* tex, image* img, GLint* x, GLint* y)
+{
+	if (img->format->format != tex->format->format || img->format->type != tex->format->type)
+		luaL_error(L, "Image format does not match texture format");
+
+	*x = luaL_checkinteger(L, 3);
+	*y = luaL_checkinteger(L, 4);
+
+	rect src = {0, 0, img->width, img->height};
+	if (!lua_isnoneornil(L, 5))
+	{
+		luaL_checktype(L, 5, LUA_TTABLE);
+		GLint* fields[] = {&src.x, &src.y, &src.width, &src.height};
+		for (int i = 0; i < 4; ++i)
+		{
+			lua_rawgeti(L, 5, i+1);
+			if (!lua_isnumber(L, -1))
+				luaL_error(L, "Invalid source rectangle: {x, y, width, height} expected");
+			*fields[i] = lua_tointeger(L, -1);
+			lua_pop(L, 1);
+		}
+	}
+
+	if (src.x < 0 || src.y < 0 || src.width < 0 || src.height < 0 ||
+	    src.x + src.width > img->width || src.y + src.height > img->height)
+		luaL_error(L, "Source rectangle exceeds image: %dx%d+%d+%d",
+		           src.width, src.height, src.x, src.y);
+	if (*x < 0 || *y < 0 || *x + src.width > tex->width || *y + src.height > tex->height)
+		luaL_error(L, "Update exceeds texture: %dx%d+%d+%d",
+		           src.width, src.height, *x, *y);
+	return src;
+}
+
+static void sub_image(texture* tex, const image* img, GLint x, GLint y, rect src)
+{
+	edit_texture(tex);
+	begin_unpack();
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, img->width);
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS, src.x);
+	glPixelStorei(GL_UNPACK_SKIP_ROWS, src.y);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, src.width, src.height,
+	                tex->format->format, tex->format->type, img->data);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+	glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+	end_unpack();
+	update_mipmaps(tex);
+}
+
+void texture_update(texture* tex, const image* img, GLint x, GLint y)
+{
+	rect src = {0, 0, img->width, img->height};
+	sub_image(tex, img, x, y, src);
+}
+
+// writes part of an image at x,y. only the updated region is transferred
+// and the storage is kept.
+static int l_texture_update(lua_State* L)
+{
+	texture* tex = l_checktexture(L, 1);
+	image* img = l_checkimage(L, 2);
+	GLint x, y;
+	rect src = check_update(L, tex, img, &x, &y);
+	sub_image(tex, img, x, y, src);
+
+	lua_settop(L, 1);
+	return 1;
+}
+
+// returns the next upload buffer with room for `size' bytes. waits if the
+// GPU still reads from it.
+static uploadbuffer* next_upload(GLsizeiptr size)
+{
+	uploadbuffer* u = &uploads[upload_next];
+	upload_next = (upload_next + 1) % UPLOAD_BUFFERS;
+
+	if (NULL != u->fence)
+	{
+		GLenum status = glClientWaitSync(u->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		while (GL_TIMEOUT_EXPIRED == status)
+			status = glClientWaitSync(u->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		glDeleteSync(u->fence);
+		u->fence = NULL;
+	}
+
+	if (0 == u->id)
+		glGenBuffers(1, &u->id);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, u->id);
+	if (size > u->size)
+	{
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+		u->size = size;
+	}
+	return u;
+}
+
+// like update, but copies the pixels to a pixel unpack buffer first. the
+// transfer to the texture happens while the CPU continues. mipmaps are not
+// regenerated, as that would have to wait for the transfer.
+static int l_texture_updateAsync(lua_State* L)
+{
+	texture* tex = l_checktexture(L, 1);
+	image* img = l_checkimage(L, 2);
+	GLint x, y;
+	rect src = check_update(L, tex, img, &x, &y);
+
+	size_t pixel = img->format->size;
+	size_t row = (size_t)src.width * pixel;
+	GLsizeiptr size = (GLsizeiptr)row * src.height;
+	if (0 == size)
+	{
+		lua_settop(L, 1);
+		return 1;
+	}
+
+	// binds the upload buffer only after begin_unpack() cleared the binding
+	begin_unpack();
+	uploadbuffer* u = next_upload(size);
+	unsigned char* dst = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (NULL == dst)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		end_unpack();
+		return luaL_error(L, "Cannot map upload buffer");
+	}
+
+	const unsigned char* pixels = (const unsigned char*)img->data;
+	for (GLsizei i = 0; i < src.height; ++i)
+		memcpy(dst + i * row, pixels + ((size_t)(src.y + i) * img->width + src.x) * pixel, row);
+	if (GL_FALSE == glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		end_unpack();
+		return luaL_error(L, "Upload buffer contents corrupted. Please update again.");
+	}
+
+	edit_texture(tex);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, src.width, src.height,
+	                tex->format->format, tex->format->type, NULL);
+	end_unpack();
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	u->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	lua_settop(L, 1);
+	return 1;
+}
+
 static int l_texture_setData(lua_State* L)
 {
 	texture* tex = l_checktexture(L, 1);
 	image* img = l_checkimage(L, 2);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, tex->id);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
+	edit_texture(tex);
+	tex->width = img->width;
+	tex->height = img->height;
+	tex->format = img->format;
+	begin_unpack();
+	glTexImage2D(GL_TEXTURE_2D, 0, tex->format->internal,
 	             (GLsizei)img->width, (GLsizei)img->height, 0,
-	             GL_RGBA, GL_UNSIGNED_BYTE, img->data);
+	             tex->format->format, tex->format->type, img->data);
+	end_unpack();
+	update_mipmaps(tex);
 
 	lua_settop(L, 1);
 	return 1;
@@ -121,22 +440,31 @@ static int l_texture___gc(lua_State* L)
 {
 	texture* tex = (texture*)lua_touserdata(L, 1);
 	glDeleteTextures(1, &tex->id);
+
+	// deleted textures are unbound from all units
+	for (int i = 0; i < unit_max; ++i)
+		if (tex->id == bindings[i])
+			bindings[i] = 0;
 	return 0;
 }
 
 int l_texture_new(lua_State* L)
 {
-	glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &unit_max);
+	init_bindings(L);
 
 	GLsizei width, height;
 	int idx_unit = 2;
 	void* data = NULL;
+	const pixelformat* format;
 	if (lua_isnumber(L, 1) && lua_isnumber(L, 2))
 	{
 		idx_unit++;
 		width  = lua_tonumber(L, 1);
 		height = lua_tonumber(L, 2);
 		data   = NULL;
+		format = image_pixelformat(luaL_optinteger(L, idx_unit + 5, GL_RGBA8));
+		if (NULL == format)
+			return luaL_error(L, "Invalid texture format: %d", lua_tointeger(L, idx_unit + 5));
 	}
 	else
 	{
@@ -144,6 +472,7 @@ int l_texture_new(lua_State* L)
 		width  = img->width;
 		height = img->height;
 		data   = img->data;
+		format = img->format;
 	}
 
 	int unit = luaL_optinteger(L, idx_unit, 1);
@@ -152,25 +481,34 @@ int l_texture_new(lua_State* L)
 
 	GLenum mag_filter = luaL_optinteger(L, idx_unit + 1, GL_LINEAR);
 	GLenum min_filter = luaL_optinteger(L, idx_unit + 2, GL_LINEAR);
+	if (uses_mipmaps(mag_filter))
+		return luaL_error(L, "Invalid magnification filter: %d", mag_filter);
 	GLenum wrap_s = luaL_optinteger(L, idx_unit + 3, GL_REPEAT);
 	GLenum wrap_t = luaL_optinteger(L, idx_unit + 4, GL_REPEAT);
 
 	GLuint id;
 	glGenTextures(1, &id);
 
-	glActiveTexture(GL_TEXTURE0 + unit);
-	glBindTexture(GL_TEXTURE_2D, id);
+	select_unit(unit);
+	bind_texture(unit, id);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mag_filter);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap_s);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap_t);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
-	             GL_RGBA, GL_UNSIGNED_BYTE, data);
+	begin_unpack();
+	glTexImage2D(GL_TEXTURE_2D, 0, format->internal, width, height, 0,
+	             format->format, format->type, data);
+	end_unpack();
 
 	texture* tex = (texture*)lua_newuserdata(L, sizeof(texture));
 	tex->id = id;
 	tex->unit = unit;
+	tex->width = width;
+	tex->height = height;
+	tex->format = format;
+	tex->mipmaps = uses_mipmaps(min_filter);
+	update_mipmaps(tex);
 
 	if (luaL_newmetatable(L, INTERNAL_NAME))
 	{
@@ -178,10 +516,15 @@ int l_texture_new(lua_State* L)
 		{
 			{"__gc",       l_texture___gc},
 			{"__index",    l_texture___index},
-			{"__newinedx", l_texture___newindex},
+			{"__newindex", l_texture___newindex},
 			{"filter",     l_texture_filter},
 			{"wrap",       l_texture_wrap},
 			{"setData",    l_texture_setData},
+			{"update",     l_texture_update},
+			{"updateAsync", l_texture_updateAsync},
+			{"generateMipmaps", l_texture_generateMipmaps},
+			{"lod",        l_texture_lod},
+			{"anisotropy", l_texture_anisotropy},
 
 			{NULL, NULL}
 		};
@@ -195,6 +538,13 @@ int l_texture_new(lua_State* L)
 void texture_bind(texture* tex)
 {
 	assert(NULL != tex);
-	glActiveTexture(GL_TEXTURE0 + tex->unit);
-	glBindTexture(GL_TEXTURE_2D, tex->id);
+	bind_texture(tex->unit, tex->id);
+}
+
+int l_texture_stats(lua_State* L)
+{
+	lua_pushinteger(L, binds_issued);
+	lua_pushinteger(L, binds_skipped);
+	binds_issued = binds_skipped = 0;
+	return 2;
 }
@@ -2,13 +2,18 @@
 #define __G4L_TEXTURE_H
 
 #include <glew.h>
+#include "image.h"
 
 struct lua_State;
 
 typedef struct
 {
-	GLuint id;
-	GLuint unit;
+	GLuint  id;
+	GLuint  unit;
+	GLsizei width;
+	GLsizei height;
+	const pixelformat* format;
+	int     mipmaps; // regenerated when the data changes
 	//GLenum target; <-- later, maybe
 } texture;
 
@@ -16,5 +21,9 @@ texture* l_checktexture(struct lua_State* L, int idx);
 int l_istexture(struct lua_State* L, int idx);
 int l_texture_new(struct lua_State* L);
 void texture_bind(texture* tex);
+int l_texture_stats(struct lua_State* L);
+
+// writes the whole image at x,y. the image must fit and match the format.
+void texture_update(texture* tex, const image* img, GLint x, GLint y);
 
 #endif
@@ -0,0 +1,156 @@
+#include "transformfeedback.h"
+#include "helper.h"
+#include "bufferobject.h"
+#include "shader.h"
+#include "uniform.h"
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include <glew.h>
+
+static void bind_feedback_buffer(bufferobject* b, GLuint index)
+{
+	if (b->regions > 0)
+		glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, index, b->id, b->offset, b->region_size);
+	else
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, index, b->id);
+}
+
+// number of components one captured vertex writes to buffer `index'
+static GLsizei captured_components(GLuint program, GLuint index)
+{
+	GLint mode = GL_INTERLEAVED_ATTRIBS, varyings = 0;
+	glGetProgramiv(program, GL_TRANSFORM_FEEDBACK_BUFFER_MODE, &mode);
+	glGetProgramiv(program, GL_TRANSFORM_FEEDBACK_VARYINGS, &varyings);
+
+	GLsizei components = 0;
+	for (GLint i = 0; i < varyings; ++i)
+	{
+		if (GL_SEPARATE_ATTRIBS == mode && (GLuint)i != index)
+			continue;
+		char name[1];
+		GLsizei size = 0;
+		GLenum type = 0;
+		glGetTransformFeedbackVarying(program, i, sizeof(name), NULL, &size, &type, name);
+		components += size * uniform_type_components(type);
+	}
+	return components;
+}
+
+// makes draw() cover exactly the captured vertices
+static void set_captured(bufferobject* b, GLuint program, GLuint index, GLsizei vertices)
+{
+	GLsizei stride = captured_components(program, index);
+	if (stride <= 0)
+		return;
+	b->stride = stride;
+	b->count = vertices * stride;
+}
+
+// g4l.transformFeedback(buffer(s), mode, fn, [rasterize = false, [count = false]])
+// captures the varyings of all draw calls in `fn' into `buffer(s)'. if
+// `count' is true, returns the number of primitives written and sets the
+// element count of `buffer(s)' accordingly. counting waits for the GPU to
+// finish the pass.
+int l_transform_feedback(lua_State* L)
+{
+	if (!context_available())
+		return luaL_error(L, "No OpenGL context available. Create a window first.");
+
+	GLenum mode = luaL_checkinteger(L, 2);
+	if (!lua_isfunction(L, 3))
+		return luaL_typerror(L, 3, "function");
+	int rasterize = lua_toboolean(L, 4);
+	int count = lua_toboolean(L, 5);
+
+	GLsizei vertices;
+	switch (mode)
+	{
+	case GL_POINTS:
+		vertices = 1;
+		break;
+	case GL_LINES:
+		vertices = 2;
+		break;
+	case GL_TRIANGLES:
+		vertices = 3;
+		break;
+	default:
+		return luaL_error(L, "Invalid primitive mode. Need points, lines or triangles.");
+	}
+
+	// one buffer or a list of buffers for separate attributes
+	int buffers = 1;
+	if (lua_istable(L, 1))
+	{
+		buffers = lua_objlen(L, 1);
+		for (int i = 1; i <= buffers; ++i)
+		{
+			lua_rawgeti(L, 1, i);
+			bind_feedback_buffer(l_checkbufferobject(L, -1), i-1);
+			lua_pop(L, 1);
+		}
+	}
+	else
+	{
+		bind_feedback_buffer(l_checkbufferobject(L, 1), 0);
+	}
+
+	GLuint query = 0;
+	if (count)
+		glGenQueries(1, &query);
+
+	if (!rasterize)
+		glEnable(GL_RASTERIZER_DISCARD);
+	shader_bind_active();
+	GLint program = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+	if (count)
+		glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, query);
+	glBeginTransformFeedback(mode);
+
+	lua_pushvalue(L, 3);
+	int status = lua_pcall(L, 0, 0, 0);
+
+	glEndTransformFeedback();
+	if (count)
+		glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+	if (!rasterize)
+		glDisable(GL_RASTERIZER_DISCARD);
+
+	for (int i = 0; i < buffers; ++i)
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, i, 0);
+
+	if (0 != status)
+	{
+		if (count)
+			glDeleteQueries(1, &query);
+		return lua_error(L);
+	}
+
+	if (!count)
+		return 0;
+
+	GLuint primitives = 0;
+	glGetQueryObjectuiv(query, GL_QUERY_RESULT, &primitives);
+	glDeleteQueries(1, &query);
+
+	vertices *= primitives;
+	if (lua_istable(L, 1))
+	{
+		for (int i = 1; i <= buffers; ++i)
+		{
+			lua_rawgeti(L, 1, i);
+			set_captured((bufferobject*)lua_touserdata(L, -1), program, i-1, vertices);
+			lua_pop(L, 1);
+		}
+	}
+	else
+	{
+		set_captured((bufferobject*)lua_touserdata(L, 1), program, 0, vertices);
+	}
+
+	lua_pushinteger(L, primitives);
+	return 1;
+}
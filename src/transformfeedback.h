@@ -0,0 +1,8 @@
+#ifndef __G4L_TRANSFORMFEEDBACK_H
+#define __G4L_TRANSFORMFEEDBACK_H
+
+struct lua_State;
+
+int l_transform_feedback(struct lua_State* L);
+
+#endif
@@ -0,0 +1,703 @@
+#include "uniform.h"
+#include "math.h"
+#include "array.h"
+#include "texture.h"
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//// UNIFORM MAP ////
+static unsigned int hash(const char* str)
+{
+	// FNV-1a
+	unsigned int h = 2166136261u;
+	for (; *str; ++str)
+		h = (h ^ (unsigned char)*str) * 16777619u;
+	return h;
+}
+
+static uniforminfo* find_slot(uniforminfo* slots, int capacity, const char* name)
+{
+	unsigned int i = hash(name) & (capacity - 1);
+	while (NULL != slots[i].name && 0 != strcmp(slots[i].name, name))
+		i = (i + 1) & (capacity - 1);
+	return &slots[i];
+}
+
+void uniformmap_init(uniformmap* m)
+{
+	m->slots = NULL;
+	m->capacity = 0;
+	m->count = 0;
+}
+
+void uniformmap_free(uniformmap* m)
+{
+	for (int i = 0; i < m->capacity; ++i)
+		free(m->slots[i].name);
+	free(m->slots);
+	uniformmap_init(m);
+}
+
+uniforminfo* uniformmap_get(const uniformmap* m, const char* name)
+{
+	if (0 == m->count)
+		return NULL;
+
+	uniforminfo* slot = find_slot(m->slots, m->capacity, name);
+	return (NULL != slot->name) ? slot : NULL;
+}
+
+// returns slot for `name', which is created if needed. NULL if out of memory.
+uniforminfo* uniformmap_insert(uniformmap* m, const char* name)
+{
+	// keep load factor below 1/2
+	if (2 * (m->count + 1) > m->capacity)
+	{
+		int capacity = (m->capacity > 0) ? m->capacity * 2 : 16;
+		uniforminfo* slots = (uniforminfo*)calloc(capacity, sizeof(uniforminfo));
+		if (NULL == slots)
+			return NULL;
+
+		for (int i = 0; i < m->capacity; ++i)
+		{
+			if (NULL != m->slots[i].name)
+				*find_slot(slots, capacity, m->slots[i].name) = m->slots[i];
+		}
+		free(m->slots);
+		m->slots = slots;
+		m->capacity = capacity;
+	}
+
+	uniforminfo* slot = find_slot(m->slots, m->capacity, name);
+	if (NULL != slot->name)
+		return slot;
+
+	size_t len = strlen(name);
+	slot->name = (char*)malloc(len + 1);
+	if (NULL == slot->name)
+		return NULL;
+	memcpy(slot->name, name, len + 1);
+	slot->location = -1;
+	slot->type = 0;
+	slot->size = 1;
+	++m->count;
+	return slot;
+}
+
+//// TYPED ASSIGNMENT ////
+// glProgramUniform* writes to the program directly. without it, the
+// program has to be bound by the caller.
+#define UNIFORM(fn, p, ...)                                                    \
+	(GLEW_ARB_separate_shader_objects ? glProgram##fn(p, __VA_ARGS__) :       \
+	 GLEW_EXT_direct_state_access     ? glProgram##fn##EXT(p, __VA_ARGS__) :  \
+	                                    gl##fn(__VA_ARGS__))
+
+int uniform_direct_access()
+{
+	return GLEW_ARB_separate_shader_objects || GLEW_EXT_direct_state_access;
+}
+
+static int is_integer_type(GLenum type)
+{
+	switch (type)
+	{
+	case GL_INT:
+	case GL_BOOL:
+	case GL_SAMPLER_1D:
+	case GL_SAMPLER_2D:
+	case GL_SAMPLER_3D:
+	case GL_SAMPLER_CUBE:
+	case GL_SAMPLER_1D_SHADOW:
+	case GL_SAMPLER_2D_SHADOW:
+	case GL_SAMPLER_1D_ARRAY:
+	case GL_SAMPLER_2D_ARRAY:
+	case GL_SAMPLER_2D_RECT:
+	case GL_SAMPLER_BUFFER:
+	case GL_SAMPLER_2D_MULTISAMPLE:
+	case GL_INT_SAMPLER_2D:
+	case GL_INT_SAMPLER_3D:
+	case GL_INT_SAMPLER_BUFFER:
+	case GL_UNSIGNED_INT_SAMPLER_2D:
+	case GL_UNSIGNED_INT_SAMPLER_3D:
+	case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+		return 1;
+	}
+	return 0;
+}
+
+int uniform_type_components(GLenum type)
+{
+	switch (type)
+	{
+	case GL_FLOAT_VEC2:
+	case GL_INT_VEC2:
+	case GL_UNSIGNED_INT_VEC2:
+	case GL_BOOL_VEC2:
+		return 2;
+	case GL_FLOAT_VEC3:
+	case GL_INT_VEC3:
+	case GL_UNSIGNED_INT_VEC3:
+	case GL_BOOL_VEC3:
+		return 3;
+	case GL_FLOAT_VEC4:
+	case GL_INT_VEC4:
+	case GL_UNSIGNED_INT_VEC4:
+	case GL_BOOL_VEC4:
+	case GL_FLOAT_MAT2:
+		return 4;
+	case GL_FLOAT_MAT3:
+		return 9;
+	case GL_FLOAT_MAT4:
+		return 16;
+	case GL_FLOAT:
+	case GL_UNSIGNED_INT:
+		return 1;
+	}
+	return is_integer_type(type) ? 1 : 0;
+}
+
+static int set_number(GLuint p, const uniforminfo* u, lua_Number v)
+{
+	if (is_integer_type(u->type))
+		UNIFORM(Uniform1i, p, u->location, (GLint)v);
+	else if (GL_UNSIGNED_INT == u->type)
+		UNIFORM(Uniform1ui, p, u->location, (GLuint)v);
+	else
+		UNIFORM(Uniform1f, p, u->location, (GLfloat)v);
+	return 1;
+}
+
+static int set_vector(GLuint p, const uniforminfo* u, const vec4* v)
+{
+	GLint iv[4];
+	GLuint uv[4];
+	for (int i = 0; i < v->dim; ++i)
+	{
+		iv[i] = (GLint)v->v[i];
+		uv[i] = (GLuint)v->v[i];
+	}
+
+	switch (u->type)
+	{
+	case GL_INT_VEC2:
+	case GL_BOOL_VEC2:
+		UNIFORM(Uniform2iv, p, u->location, 1, iv);
+		return 1;
+	case GL_INT_VEC3:
+	case GL_BOOL_VEC3:
+		UNIFORM(Uniform3iv, p, u->location, 1, iv);
+		return 1;
+	case GL_INT_VEC4:
+	case GL_BOOL_VEC4:
+		UNIFORM(Uniform4iv, p, u->location, 1, iv);
+		return 1;
+	case GL_UNSIGNED_INT_VEC2:
+		UNIFORM(Uniform2uiv, p, u->location, 1, uv);
+		return 1;
+	case GL_UNSIGNED_INT_VEC3:
+		UNIFORM(Uniform3uiv, p, u->location, 1, uv);
+		return 1;
+	case GL_UNSIGNED_INT_VEC4:
+		UNIFORM(Uniform4uiv, p, u->location, 1, uv);
+		return 1;
+	}
+
+	switch (v->dim)
+	{
+	case 2:
+		UNIFORM(Uniform2fv, p, u->location, 1, v->v);
+		return 1;
+	case 3:
+		UNIFORM(Uniform3fv, p, u->location, 1, v->v);
+		return 1;
+	case 4:
+		UNIFORM(Uniform4fv, p, u->location, 1, v->v);
+		return 1;
+	}
+	return 0;
+}
+
+static int set_matrix(GLuint p, const uniforminfo* u, const mat44* m)
+{
+	switch (m->rows)
+	{
+	case 2:
+		UNIFORM(UniformMatrix2fv, p, u->location, 1, GL_TRUE, m->m);
+		return 1;
+	case 3:
+		UNIFORM(UniformMatrix3fv, p, u->location, 1, GL_TRUE, m->m);
+		return 1;
+	case 4:
+		UNIFORM(UniformMatrix4fv, p, u->location, 1, GL_TRUE, m->m);
+		return 1;
+	}
+	return 0;
+}
+
+// uploads a whole uniform array from a g4l.array in one call
+static int set_array(GLuint p, const uniforminfo* u, const array* a)
+{
+	int components = uniform_type_components(u->type);
+	if (0 == components)
+		components = 1;
+	GLsizei count = a->count / components;
+
+	if (GL_FLOAT == a->element_type)
+	{
+		const GLfloat* v = (const GLfloat*)a->data;
+		switch (u->type)
+		{
+		case 0:
+		case GL_FLOAT:      UNIFORM(Uniform1fv, p, u->location, count, v); return 1;
+		case GL_FLOAT_VEC2: UNIFORM(Uniform2fv, p, u->location, count, v); return 1;
+		case GL_FLOAT_VEC3: UNIFORM(Uniform3fv, p, u->location, count, v); return 1;
+		case GL_FLOAT_VEC4: UNIFORM(Uniform4fv, p, u->location, count, v); return 1;
+		case GL_FLOAT_MAT2: UNIFORM(UniformMatrix2fv, p, u->location, count, GL_TRUE, v); return 1;
+		case GL_FLOAT_MAT3: UNIFORM(UniformMatrix3fv, p, u->location, count, GL_TRUE, v); return 1;
+		case GL_FLOAT_MAT4: UNIFORM(UniformMatrix4fv, p, u->location, count, GL_TRUE, v); return 1;
+		}
+	}
+	else if (GL_INT == a->element_type)
+	{
+		const GLint* v = (const GLint*)a->data;
+		switch (u->type)
+		{
+		case GL_INT_VEC2:
+		case GL_BOOL_VEC2: UNIFORM(Uniform2iv, p, u->location, count, v); return 1;
+		case GL_INT_VEC3:
+		case GL_BOOL_VEC3: UNIFORM(Uniform3iv, p, u->location, count, v); return 1;
+		case GL_INT_VEC4:
+		case GL_BOOL_VEC4: UNIFORM(Uniform4iv, p, u->location, count, v); return 1;
+		}
+		if (0 == u->type || is_integer_type(u->type))
+		{
+			UNIFORM(Uniform1iv, p, u->location, count, v);
+			return 1;
+		}
+	}
+	else if (GL_UNSIGNED_INT == a->element_type)
+	{
+		const GLuint* v = (const GLuint*)a->data;
+		switch (u->type)
+		{
+		case 0:
+		case GL_UNSIGNED_INT:      UNIFORM(Uniform1uiv, p, u->location, count, v); return 1;
+		case GL_UNSIGNED_INT_VEC2: UNIFORM(Uniform2uiv, p, u->location, count, v); return 1;
+		case GL_UNSIGNED_INT_VEC3: UNIFORM(Uniform3uiv, p, u->location, count, v); return 1;
+		case GL_UNSIGNED_INT_VEC4: UNIFORM(Uniform4uiv, p, u->location, count, v); return 1;
+		}
+	}
+	return 0;
+}
+
+// component type of values passed to glUniform*v
+static GLenum base_type(GLenum type)
+{
+	switch (type)
+	{
+	case GL_UNSIGNED_INT:
+	case GL_UNSIGNED_INT_VEC2:
+	case GL_UNSIGNED_INT_VEC3:
+	case GL_UNSIGNED_INT_VEC4:
+		return GL_UNSIGNED_INT;
+	case GL_INT_VEC2:
+	case GL_INT_VEC3:
+	case GL_INT_VEC4:
+	case GL_BOOL_VEC2:
+	case GL_BOOL_VEC3:
+	case GL_BOOL_VEC4:
+		return GL_INT;
+	}
+	return is_integer_type(type) ? GL_INT : GL_FLOAT;
+}
+
+// number of values of a table element. 0 if not a number, vector or matrix.
+static int element_components(lua_State* L, int idx)
+{
+	if (lua_isnumber(L, idx))
+		return 1;
+	if (l_isanyvec(L, idx))
+		return ((vec4*)lua_touserdata(L, idx))->dim;
+	if (l_isanymat(L, idx))
+	{
+		mat44* m = (mat44*)lua_touserdata(L, idx);
+		return m->rows * m->cols;
+	}
+	return 0;
+}
+
+// uploads a table of numbers, vectors or matrices to a uniform array in
+// one call
+static int set_table(lua_State* L, GLuint p, const uniforminfo* u, int idx)
+{
+	int n = lua_objlen(L, idx);
+	GLsizei total = 0;
+	for (int i = 1; i <= n; ++i)
+	{
+		lua_rawgeti(L, idx, i);
+		int components = element_components(L, lua_gettop(L));
+		lua_pop(L, 1);
+		if (0 == components)
+			return luaL_error(L, "Invalid uniform array element #%d", i);
+		total += components;
+	}
+
+	int components = uniform_type_components(u->type);
+	if (0 == total || 0 == components)
+		return 0;
+	if (total % components != 0)
+		return luaL_error(L, "Invalid uniform array: %d values are not a multiple of %d",
+		                  total, components);
+
+	array a;
+	a.element_type = base_type(u->type);
+	a.element_size = array_type_size(a.element_type);
+	a.count = total;
+	a.data = malloc(total * a.element_size);
+	if (NULL == a.data)
+		return luaL_error(L, "Out of memory");
+
+	GLsizei k = 0;
+	for (int i = 1; i <= n; ++i)
+	{
+		lua_rawgeti(L, idx, i);
+		int top = lua_gettop(L);
+		if (lua_isnumber(L, top))
+		{
+			array_set(&a, k++, lua_tonumber(L, top));
+		}
+		else if (l_isanyvec(L, top))
+		{
+			vec4* v = (vec4*)lua_touserdata(L, top);
+			for (int c = 0; c < v->dim; ++c)
+				array_set(&a, k++, v->v[c]);
+		}
+		else
+		{
+			// row major, like single matrices
+			mat44* m = (mat44*)lua_touserdata(L, top);
+			for (int c = 0; c < m->rows * m->cols; ++c)
+				array_set(&a, k++, m->m[c]);
+		}
+		lua_pop(L, 1);
+	}
+
+	int ok = set_array(p, u, &a);
+	free(a.data);
+	return ok;
+}
+
+int uniform_set(lua_State* L, GLuint p, const uniforminfo* u, int idx)
+{
+	if (lua_isnumber(L, idx))
+		return set_number(p, u, lua_tonumber(L, idx));
+	if (lua_isboolean(L, idx))
+		return set_number(p, u, lua_toboolean(L, idx));
+	if (l_isanyvec(L, idx))
+		return set_vector(p, u, (vec4*)lua_touserdata(L, idx));
+	if (l_isanymat(L, idx))
+		return set_matrix(p, u, (mat44*)lua_touserdata(L, idx));
+	if (l_isarray(L, idx))
+		return set_array(p, u, (array*)lua_touserdata(L, idx));
+	if (lua_istable(L, idx))
+		return set_table(L, p, u, idx);
+	if (l_istexture(L, idx))
+	{
+		texture* tex = (texture*)lua_touserdata(L, idx);
+		texture_bind(tex);
+		UNIFORM(Uniform1i, p, u->location, tex->unit);
+		return 1;
+	}
+	return 0;
+}
+
+static void copy_value(GLuint from, GLint src, GLuint p, GLint location, GLenum type)
+{
+	GLfloat f[16];
+	GLint i[4];
+	GLuint u[4];
+
+	switch (type)
+	{
+	case GL_FLOAT:
+	case GL_FLOAT_VEC2:
+	case GL_FLOAT_VEC3:
+	case GL_FLOAT_VEC4:
+	case GL_FLOAT_MAT2:
+	case GL_FLOAT_MAT3:
+	case GL_FLOAT_MAT4:
+		glGetUniformfv(from, src, f);
+		break;
+	case GL_UNSIGNED_INT:
+	case GL_UNSIGNED_INT_VEC2:
+	case GL_UNSIGNED_INT_VEC3:
+	case GL_UNSIGNED_INT_VEC4:
+		glGetUniformuiv(from, src, u);
+		break;
+	default:
+		if (0 == uniform_type_components(type))
+			return;
+		glGetUniformiv(from, src, i);
+	}
+
+	// values are read back in column major order
+	switch (type)
+	{
+	case GL_FLOAT:             UNIFORM(Uniform1fv, p, location, 1, f); return;
+	case GL_FLOAT_VEC2:        UNIFORM(Uniform2fv, p, location, 1, f); return;
+	case GL_FLOAT_VEC3:        UNIFORM(Uniform3fv, p, location, 1, f); return;
+	case GL_FLOAT_VEC4:        UNIFORM(Uniform4fv, p, location, 1, f); return;
+	case GL_FLOAT_MAT2:        UNIFORM(UniformMatrix2fv, p, location, 1, GL_FALSE, f); return;
+	case GL_FLOAT_MAT3:        UNIFORM(UniformMatrix3fv, p, location, 1, GL_FALSE, f); return;
+	case GL_FLOAT_MAT4:        UNIFORM(UniformMatrix4fv, p, location, 1, GL_FALSE, f); return;
+	case GL_UNSIGNED_INT:      UNIFORM(Uniform1uiv, p, location, 1, u); return;
+	case GL_UNSIGNED_INT_VEC2: UNIFORM(Uniform2uiv, p, location, 1, u); return;
+	case GL_UNSIGNED_INT_VEC3: UNIFORM(Uniform3uiv, p, location, 1, u); return;
+	case GL_UNSIGNED_INT_VEC4: UNIFORM(Uniform4uiv, p, location, 1, u); return;
+	case GL_INT_VEC2:
+	case GL_BOOL_VEC2:         UNIFORM(Uniform2iv, p, location, 1, i); return;
+	case GL_INT_VEC3:
+	case GL_BOOL_VEC3:         UNIFORM(Uniform3iv, p, location, 1, i); return;
+	case GL_INT_VEC4:
+	case GL_BOOL_VEC4:         UNIFORM(Uniform4iv, p, location, 1, i); return;
+	default:                   UNIFORM(Uniform1iv, p, location, 1, i); return;
+	}
+}
+
+void uniform_copy(GLuint from, GLuint to)
+{
+	GLint count = 0, maxlen = 0;
+	glGetProgramiv(from, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(from, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxlen);
+
+	// room for the name and an [index] suffix
+	char* name = (char*)malloc(2 * (maxlen + 16));
+	if (NULL == name)
+		return;
+	char* element = name + maxlen + 16;
+
+	for (GLint k = 0; k < count; ++k)
+	{
+		GLint size;
+		GLenum type;
+		glGetActiveUniform(from, k, maxlen, NULL, &size, &type, name);
+
+		// arrays are reported as name[0]
+		size_t len = strlen(name);
+		if (len > 3 && 0 == strcmp(name + len - 3, "[0]"))
+			name[len - 3] = '\0';
+
+		for (GLint e = 0; e < size; ++e)
+		{
+			if (size > 1)
+				sprintf(element, "%s[%d]", name, (int)e);
+			else
+				strcpy(element, name);
+
+			// members of uniform blocks have no location
+			GLint src = glGetUniformLocation(from, element);
+			GLint dst = glGetUniformLocation(to, element);
+			if (-1 != src && -1 != dst)
+				copy_value(from, src, to, dst, type);
+		}
+	}
+	free(name);
+}
+
+//// INTROSPECTION ////
+const char* uniform_type_name(GLenum type)
+{
+	switch (type)
+	{
+	case GL_FLOAT:                   return "float";
+	case GL_FLOAT_VEC2:              return "vec2";
+	case GL_FLOAT_VEC3:              return "vec3";
+	case GL_FLOAT_VEC4:              return "vec4";
+	case GL_INT:                     return "int";
+	case GL_INT_VEC2:                return "ivec2";
+	case GL_INT_VEC3:                return "ivec3";
+	case GL_INT_VEC4:                return "ivec4";
+	case GL_UNSIGNED_INT:            return "uint";
+	case GL_UNSIGNED_INT_VEC2:       return "uvec2";
+	case GL_UNSIGNED_INT_VEC3:       return "uvec3";
+	case GL_UNSIGNED_INT_VEC4:       return "uvec4";
+	case GL_BOOL:                    return "bool";
+	case GL_BOOL_VEC2:               return "bvec2";
+	case GL_BOOL_VEC3:               return "bvec3";
+	case GL_BOOL_VEC4:               return "bvec4";
+	case GL_FLOAT_MAT2:              return "mat2";
+	case GL_FLOAT_MAT3:              return "mat3";
+	case GL_FLOAT_MAT4:              return "mat4";
+	case GL_FLOAT_MAT2x3:            return "mat2x3";
+	case GL_FLOAT_MAT2x4:            return "mat2x4";
+	case GL_FLOAT_MAT3x2:            return "mat3x2";
+	case GL_FLOAT_MAT3x4:            return "mat3x4";
+	case GL_FLOAT_MAT4x2:            return "mat4x2";
+	case GL_FLOAT_MAT4x3:            return "mat4x3";
+	case GL_SAMPLER_1D:              return "sampler1D";
+	case GL_SAMPLER_2D:              return "sampler2D";
+	case GL_SAMPLER_3D:              return "sampler3D";
+	case GL_SAMPLER_CUBE:            return "samplerCube";
+	case GL_SAMPLER_1D_SHADOW:       return "sampler1DShadow";
+	case GL_SAMPLER_2D_SHADOW:       return "sampler2DShadow";
+	case GL_SAMPLER_1D_ARRAY:        return "sampler1DArray";
+	case GL_SAMPLER_2D_ARRAY:        return "sampler2DArray";
+	case GL_SAMPLER_2D_RECT:         return "sampler2DRect";
+	case GL_SAMPLER_BUFFER:          return "samplerBuffer";
+	case GL_SAMPLER_2D_MULTISAMPLE:  return "sampler2DMS";
+	case GL_INT_SAMPLER_2D:          return "isampler2D";
+	case GL_INT_SAMPLER_3D:          return "isampler3D";
+	case GL_INT_SAMPLER_BUFFER:      return "isamplerBuffer";
+	case GL_UNSIGNED_INT_SAMPLER_2D: return "usampler2D";
+	case GL_UNSIGNED_INT_SAMPLER_3D: return "usampler3D";
+	case GL_UNSIGNED_INT_SAMPLER_BUFFER: return "usamplerBuffer";
+	}
+	return "unknown";
+}
+
+// records name, type, size and location of all active uniforms and
+// attributes of `program'. arrays are recorded without the [0] suffix.
+// members of uniform blocks have no location and are skipped.
+void uniform_introspect(uniformmap* uniforms, uniformmap* attributes, GLuint program)
+{
+	GLint count = 0, maxlen = 0, len;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxlen);
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &len);
+	if (len > maxlen)
+		maxlen = len;
+
+	char* name = (char*)malloc(maxlen + 1);
+	if (NULL == name)
+		return;
+
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+	for (GLint i = 0; i < count; ++i)
+	{
+		GLint size;
+		GLenum type;
+		glGetActiveUniform(program, i, maxlen + 1, &len, &size, &type, name);
+		GLint location = glGetUniformLocation(program, name);
+		if (-1 == location)
+			continue;
+
+		if (len > 3 && 0 == strcmp(name + len - 3, "[0]"))
+			name[len - 3] = '\0';
+
+		uniforminfo* u = uniformmap_insert(uniforms, name);
+		if (NULL == u)
+			break;
+		u->location = location;
+		u->type = type;
+		u->size = size;
+	}
+
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+	for (GLint i = 0; i < count; ++i)
+	{
+		GLint size;
+		GLenum type;
+		glGetActiveAttrib(program, i, maxlen + 1, NULL, &size, &type, name);
+		GLint location = glGetAttribLocation(program, name);
+		if (-1 == location)
+			continue;
+
+		uniforminfo* a = uniformmap_insert(attributes, name);
+		if (NULL == a)
+			break;
+		a->location = location;
+		a->type = type;
+		a->size = size;
+	}
+
+	free(name);
+}
+
+// pushes the value at `location' of a uniform with the type of `u'
+static int push_element(lua_State* L, GLuint p, const uniforminfo* u, GLint location)
+{
+	GLfloat f[16];
+	GLint i[4];
+	GLuint ui[4];
+
+	switch (u->type)
+	{
+	case GL_FLOAT:
+		glGetUniformfv(p, location, f);
+		lua_pushnumber(L, f[0]);
+		return 1;
+	case GL_UNSIGNED_INT:
+		glGetUniformuiv(p, location, ui);
+		lua_pushnumber(L, ui[0]);
+		return 1;
+	case GL_BOOL:
+		glGetUniformiv(p, location, i);
+		lua_pushboolean(L, i[0]);
+		return 1;
+	case GL_FLOAT_VEC2:
+	case GL_FLOAT_VEC3:
+	case GL_FLOAT_VEC4:
+	case GL_INT_VEC2:
+	case GL_INT_VEC3:
+	case GL_INT_VEC4:
+	case GL_UNSIGNED_INT_VEC2:
+	case GL_UNSIGNED_INT_VEC3:
+	case GL_UNSIGNED_INT_VEC4:
+	case GL_BOOL_VEC2:
+	case GL_BOOL_VEC3:
+	case GL_BOOL_VEC4:
+		// integer values are converted by GL
+		glGetUniformfv(p, location, f);
+		l_pushvec(L, uniform_type_components(u->type), f);
+		return 1;
+	case GL_FLOAT_MAT2:
+	case GL_FLOAT_MAT3:
+	case GL_FLOAT_MAT4:
+	{
+		// GL returns column major order
+		int n = (GL_FLOAT_MAT2 == u->type) ? 2 : (GL_FLOAT_MAT3 == u->type) ? 3 : 4;
+		GLfloat m[16];
+		glGetUniformfv(p, location, f);
+		for (int r = 0; r < n; ++r)
+			for (int c = 0; c < n; ++c)
+				m[r * n + c] = f[c * n + r];
+		l_pushmat(L, n, m);
+		return 1;
+	}
+	}
+
+	if (is_integer_type(u->type))
+	{
+		glGetUniformiv(p, location, i);
+		lua_pushinteger(L, i[0]);
+		return 1;
+	}
+	return 0;
+}
+
+int uniform_get(lua_State* L, GLuint p, const uniforminfo* u)
+{
+	if (0 == uniform_type_components(u->type))
+		return 0;
+
+	if (u->size <= 1)
+		return push_element(L, p, u, u->location);
+
+	// arrays are returned as table
+	lua_createtable(L, u->size, 0);
+	for (GLint i = 0; i < u->size; ++i)
+	{
+		lua_pushfstring(L, "%s[%d]", u->name, (int)i);
+		GLint location = glGetUniformLocation(p, lua_tostring(L, -1));
+		lua_pop(L, 1);
+
+		if (-1 == location || !push_element(L, p, u, location))
+			lua_pushnil(L);
+		lua_rawseti(L, -2, i+1);
+	}
+	return 1;
+}
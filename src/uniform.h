@@ -0,0 +1,53 @@
+#ifndef __G4L_UNIFORM_H
+#define __G4L_UNIFORM_H
+
+#include <glew.h>
+
+struct lua_State;
+
+typedef struct
+{
+	char*  name;
+	GLint  location;
+	GLenum type;
+	GLint  size;
+} uniforminfo;
+
+// open addressing hash map from uniform (or attribute) name to its info
+typedef struct
+{
+	uniforminfo* slots;
+	int          capacity;
+	int          count;
+} uniformmap;
+
+void uniformmap_init(uniformmap* m);
+void uniformmap_free(uniformmap* m);
+uniforminfo* uniformmap_get(const uniformmap* m, const char* name);
+uniforminfo* uniformmap_insert(uniformmap* m, const char* name);
+
+// nonzero if uniforms can be set without binding the program
+int uniform_direct_access();
+
+// sets the value at `idx' according to the uniform's type. program `p' must
+// be bound unless uniform_direct_access(). returns 0 if the value cannot be
+// assigned to the uniform.
+int uniform_set(struct lua_State* L, GLuint p, const uniforminfo* u, int idx);
+
+// copies the values of all uniforms of program `from' to the uniforms with
+// the same names in `to'. `to' must be bound unless uniform_direct_access().
+void uniform_copy(GLuint from, GLuint to);
+
+// records all active uniforms and attributes of `program'
+void uniform_introspect(uniformmap* uniforms, uniformmap* attributes, GLuint program);
+
+// pushes the current value of the uniform in the shape of its type. returns
+// 0 and pushes nothing if the type is not supported.
+int uniform_get(struct lua_State* L, GLuint p, const uniforminfo* u);
+
+const char* uniform_type_name(GLenum type);
+
+// number of scalar components of a uniform type. 0 if unknown.
+int uniform_type_components(GLenum type);
+
+#endif
@@ -0,0 +1,356 @@
+#include "uniformbuffer.h"
+#include "helper.h"
+#include "shader.h"
+#include "math.h"
+#include "array.h"
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include <glew.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char* INTERNAL_NAME = "G4L.uniformbuffer";
+
+uniformbuffer* l_checkuniformbuffer(lua_State* L, int idx)
+{
+	return (uniformbuffer*)luaL_checkudata(L, idx, INTERNAL_NAME);
+}
+
+static uniformmember* find_member(uniformbuffer* u, const char* name)
+{
+	for (int i = 0; i < u->member_count; ++i)
+	{
+		if (0 == strcmp(u->members[i].name, name))
+			return &(u->members[i]);
+	}
+	return NULL;
+}
+
+static void pack_floats(lua_State* L, int idx, int n, char* dst)
+{
+	if (1 == n)
+	{
+		*(GLfloat*)dst = (GLfloat)luaL_checknumber(L, idx);
+		return;
+	}
+
+	if (!l_isvec(n, L, idx))
+		luaL_error(L, "Cannot set uniform block member: Expected vec%d", n);
+	memcpy(dst, ((vec4*)lua_touserdata(L, idx))->v, n * sizeof(GLfloat));
+}
+
+// std140: matrices are stored as `n' columns of `matrix_stride' bytes,
+// or as `n' rows if the member is declared row_major.
+// G4L matrices are row major.
+static void pack_matrix(lua_State* L, int idx, int n, const uniformmember* member, char* dst)
+{
+	if (!l_ismat(n, n, L, idx))
+		luaL_error(L, "Cannot set uniform block member: Expected mat%d%d", n, n);
+
+	mat44* m = (mat44*)lua_touserdata(L, idx);
+	for (int i = 0; i < n; ++i)
+	{
+		GLfloat* vec = (GLfloat*)(dst + i * member->matrix_stride);
+		for (int k = 0; k < n; ++k)
+			vec[k] = member->row_major ? m->m[i * n + k] : m->m[k * n + i];
+	}
+}
+
+// packs the value at (absolute) `idx' into one element of `m'
+static void pack_element(lua_State* L, uniformmember* m, int idx, char* dst)
+{
+	switch (m->type)
+	{
+	case GL_FLOAT:
+		pack_floats(L, idx, 1, dst);
+		break;
+	case GL_FLOAT_VEC2:
+		pack_floats(L, idx, 2, dst);
+		break;
+	case GL_FLOAT_VEC3:
+		pack_floats(L, idx, 3, dst);
+		break;
+	case GL_FLOAT_VEC4:
+		pack_floats(L, idx, 4, dst);
+		break;
+	case GL_INT:
+		*(GLint*)dst = (GLint)luaL_checkinteger(L, idx);
+		break;
+	case GL_UNSIGNED_INT:
+		*(GLuint*)dst = (GLuint)luaL_checkinteger(L, idx);
+		break;
+	case GL_BOOL:
+		*(GLuint*)dst = lua_isnumber(L, idx) ? (0 != lua_tonumber(L, idx)) : lua_toboolean(L, idx);
+		break;
+	case GL_FLOAT_MAT2:
+		pack_matrix(L, idx, 2, m, dst);
+		break;
+	case GL_FLOAT_MAT3:
+		pack_matrix(L, idx, 3, m, dst);
+		break;
+	case GL_FLOAT_MAT4:
+		pack_matrix(L, idx, 4, m, dst);
+		break;
+	default:
+		luaL_error(L, "Cannot set uniform block member `%s': Unsupported type", m->name);
+	}
+}
+
+static void pack_member(lua_State* L, uniformbuffer* u, uniformmember* m, int idx)
+{
+	if (idx < 0)
+		idx += lua_gettop(L) + 1;
+
+	char* dst = u->data + m->offset;
+	u->dirty = 1;
+
+	if (m->size == 1)
+	{
+		pack_element(L, m, idx, dst);
+		return;
+	}
+
+	// arrays: list of values or g4l.array of numbers
+	if (l_isarray(L, idx))
+	{
+		array* a = (array*)lua_touserdata(L, idx);
+		if (GL_FLOAT != m->type && GL_INT != m->type && GL_UNSIGNED_INT != m->type)
+			luaL_error(L, "Cannot set uniform block member `%s' from array", m->name);
+		int count = a->count < m->size ? a->count : m->size;
+		for (int i = 0; i < count; ++i)
+		{
+			char* p = dst + i * m->array_stride;
+			if (GL_FLOAT == m->type)
+				*(GLfloat*)p = (GLfloat)array_get(a, i);
+			else
+				*(GLint*)p = (GLint)array_get(a, i);
+		}
+		return;
+	}
+
+	if (!lua_istable(L, idx))
+		luaL_error(L, "Cannot set uniform block member `%s': Expected table or array", m->name);
+
+	int count = lua_objlen(L, idx);
+	if (count > m->size)
+		count = m->size;
+	for (int i = 0; i < count; ++i)
+	{
+		lua_rawgeti(L, idx, i+1);
+		pack_element(L, m, lua_gettop(L), dst + i * m->array_stride);
+		lua_pop(L, 1);
+	}
+}
+
+static int l_uniformbuffer___index(lua_State* L)
+{
+	luaL_getmetatable(L, INTERNAL_NAME);
+	lua_pushvalue(L, 2);
+	lua_rawget(L, -2);
+	if (!lua_isnoneornil(L, -1))
+		return 1;
+
+	uniformbuffer* u = (uniformbuffer*)lua_touserdata(L, 1);
+	const char* key = luaL_checkstring(L, 2);
+	if (0 == strcmp(key, "size"))
+		lua_pushinteger(L, u->size);
+	else
+		lua_pushnil(L);
+	return 1;
+}
+
+static int l_uniformbuffer___newindex(lua_State* L)
+{
+	uniformbuffer* u = (uniformbuffer*)lua_touserdata(L, 1);
+	const char* name = luaL_checkstring(L, 2);
+	uniformmember* m = find_member(u, name);
+	if (NULL == m)
+		return luaL_error(L, "`%s' not found in uniform block", name);
+
+	pack_member(L, u, m, 3);
+	return 0;
+}
+
+static int l_uniformbuffer_set(lua_State* L)
+{
+	uniformbuffer* u = l_checkuniformbuffer(L, 1);
+	if (!lua_istable(L, 2))
+		return luaL_typerror(L, 2, "table");
+
+	lua_pushnil(L);
+	while (lua_next(L, 2))
+	{
+		const char* name = lua_tostring(L, -2);
+		uniformmember* m = (NULL != name) ? find_member(u, name) : NULL;
+		if (NULL == m)
+			return luaL_error(L, "`%s' not found in uniform block", name ? name : "?");
+
+		pack_member(L, u, m, -1);
+		lua_pop(L, 1);
+	}
+
+	lua_settop(L, 1);
+	return 1;
+}
+
+// uploads pending changes and binds buffer to a uniform binding point
+static int l_uniformbuffer_bind(lua_State* L)
+{
+	uniformbuffer* u = l_checkuniformbuffer(L, 1);
+	GLuint binding = luaL_checkinteger(L, 2);
+
+	if (u->dirty)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, u->id);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, u->size, u->data);
+		u->dirty = 0;
+	}
+
+	glGetError();
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, u->id);
+	if (GL_NO_ERROR != glGetError())
+		return luaL_error(L, "Invalid binding point: %d", binding);
+
+	lua_settop(L, 1);
+	return 1;
+}
+
+static int l_uniformbuffer_members(lua_State* L)
+{
+	uniformbuffer* u = l_checkuniformbuffer(L, 1);
+
+	lua_createtable(L, 0, u->member_count);
+	for (int i = 0; i < u->member_count; ++i)
+	{
+		uniformmember* m = &(u->members[i]);
+		lua_createtable(L, 0, 3);
+		lua_pushinteger(L, m->type);
+		lua_setfield(L, -2, "type");
+		lua_pushinteger(L, m->size);
+		lua_setfield(L, -2, "size");
+		lua_pushinteger(L, m->offset);
+		lua_setfield(L, -2, "offset");
+		lua_setfield(L, -2, m->name);
+	}
+	return 1;
+}
+
+static int l_uniformbuffer___gc(lua_State* L)
+{
+	uniformbuffer* u = (uniformbuffer*)lua_touserdata(L, 1);
+	for (int i = 0; i < u->member_count; ++i)
+		free(u->members[i].name);
+	free(u->members);
+	free(u->data);
+	u->members = NULL;
+	u->data = NULL;
+	u->member_count = 0;
+	glDeleteBuffers(1, &u->id);
+	return 0;
+}
+
+// g4l.uniformbuffer(shader, block) creates a buffer matching the layout
+// of uniform block `block' in `shader'. declare the block as std140 to
+// share the buffer between programs.
+int l_uniformbuffer_new(lua_State* L)
+{
+	if (!context_available())
+		return luaL_error(L, "No OpenGL context available. Create a window first.");
+
+	assert_extension(L, ARB_uniform_buffer_object);
+
+	shader* s = l_checkshader(L, 1);
+	const char* block_name = luaL_checkstring(L, 2);
+
+	GLuint block = glGetUniformBlockIndex(s->id, block_name);
+	if (GL_INVALID_INDEX == block)
+		return luaL_error(L, "Uniform block `%s' not found", block_name);
+
+	GLint size = 0, count = 0;
+	glGetActiveUniformBlockiv(s->id, block, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+	glGetActiveUniformBlockiv(s->id, block, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &count);
+
+	uniformbuffer* u = (uniformbuffer*)lua_newuserdata(L, sizeof(uniformbuffer));
+	u->id = 0;
+	u->size = size;
+	u->dirty = 1;
+	u->member_count = 0;
+	u->members = (uniformmember*)calloc(count + 1, sizeof(uniformmember));
+	u->data = (char*)calloc(size + 1, 1);
+
+	if (luaL_newmetatable(L, INTERNAL_NAME))
+	{
+		luaL_reg meta[] =
+		{
+			{"__gc",       l_uniformbuffer___gc},
+			{"__index",    l_uniformbuffer___index},
+			{"__newindex", l_uniformbuffer___newindex},
+			{"set",        l_uniformbuffer_set},
+			{"bind",       l_uniformbuffer_bind},
+			{"members",    l_uniformbuffer_members},
+			{NULL, NULL}
+		};
+		l_registerFunctions(L, -1, meta);
+	}
+	lua_setmetatable(L, -2);
+
+	if (NULL == u->members || NULL == u->data)
+		return luaL_error(L, "Out of memory");
+
+	// introspect member layout
+	GLuint* indices = (GLuint*)malloc((count + 1) * sizeof(GLuint));
+	GLint* params = (GLint*)malloc((count + 1) * sizeof(GLint));
+	if (NULL == indices || NULL == params)
+	{
+		free(indices);
+		free(params);
+		return luaL_error(L, "Out of memory");
+	}
+	glGetActiveUniformBlockiv(s->id, block, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, (GLint*)indices);
+
+#define _QUERY(pname, field)                                          \
+	glGetActiveUniformsiv(s->id, count, indices, pname, params);     \
+	for (int i = 0; i < count; ++i)                                   \
+		u->members[i].field = params[i];
+
+	_QUERY(GL_UNIFORM_TYPE,          type);
+	_QUERY(GL_UNIFORM_SIZE,          size);
+	_QUERY(GL_UNIFORM_OFFSET,        offset);
+	_QUERY(GL_UNIFORM_ARRAY_STRIDE,  array_stride);
+	_QUERY(GL_UNIFORM_MATRIX_STRIDE, matrix_stride);
+	_QUERY(GL_UNIFORM_IS_ROW_MAJOR,  row_major);
+#undef _QUERY
+
+	GLint max_length = 0;
+	glGetProgramiv(s->id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+	for (int i = 0; i < count; ++i)
+	{
+		char* name = (char*)malloc(max_length + 1);
+		if (NULL == name)
+			break;
+		glGetActiveUniformName(s->id, indices[i], max_length + 1, NULL, name);
+
+		// arrays are reported as `name[0]'. members of struct arrays like
+		// `lights[1].color' keep their full path.
+		size_t len = strlen(name);
+		if (len > 3 && 0 == strcmp(name + len - 3, "[0]"))
+			name[len - 3] = '\0';
+
+		u->members[i].name = name;
+		u->member_count = i + 1;
+	}
+	free(indices);
+	free(params);
+
+	if (u->member_count != count)
+		return luaL_error(L, "Out of memory");
+
+	glGenBuffers(1, &u->id);
+	glBindBuffer(GL_UNIFORM_BUFFER, u->id);
+	glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+
+	return 1;
+}
@@ -0,0 +1,32 @@
+#ifndef __G4L_UNIFORMBUFFER_H
+#define __G4L_UNIFORMBUFFER_H
+
+#include <glew.h>
+
+struct lua_State;
+
+typedef struct
+{
+	char*  name;
+	GLenum type;
+	GLint  size;
+	GLint  offset;
+	GLint  array_stride;
+	GLint  matrix_stride;
+	GLint  row_major;
+} uniformmember;
+
+typedef struct
+{
+	GLuint         id;
+	GLsizei        size;
+	char*          data;
+	int            dirty;
+	int            member_count;
+	uniformmember* members;
+} uniformbuffer;
+
+uniformbuffer* l_checkuniformbuffer(struct lua_State* L, int idx);
+int l_uniformbuffer_new(struct lua_State* L);
+
+#endif
@@ -0,0 +1,217 @@
+#include "vertexarray.h"
+#include "helper.h"
+#include "shader.h"
+
+#include <lua.h>
+#include <lauxlib.h>
+
+static const char* INTERNAL_NAME = "G4L.vertexarray";
+static const char* BUFFERS_NAME  = "G4L.vertexarray.buffers";
+
+vertexarray* l_checkvertexarray(lua_State* L, int idx)
+{
+	return (vertexarray*)luaL_checkudata(L, idx, INTERNAL_NAME);
+}
+
+// records attribute pointers and index buffer in the vertex array
+static void setup(vertexarray* va)
+{
+	bufferobject* b = va->vertices;
+
+	glBindVertexArray(va->id);
+	glBindBuffer(GL_ARRAY_BUFFER, b->id);
+	for (int i = 0; i < va->attribute_count; ++i)
+	{
+		vertexattribute* a = &(va->attributes[i]);
+		glEnableVertexAttribArray(a->location);
+		glVertexAttribPointer(a->location, a->size, b->element_type, GL_FALSE,
+		                      b->element_size * va->stride,
+		                      (GLvoid*)((char*)NULL + b->offset + b->element_size * a->offset));
+	}
+
+	if (NULL != va->indices)
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, va->indices->id);
+
+	glBindVertexArray(0);
+
+	va->vertices_id     = b->id;
+	va->vertices_offset = b->offset;
+	va->indices_id      = (NULL != va->indices) ? va->indices->id : 0;
+}
+
+// buffers may have moved to new storage (growth) or to another streaming
+// region since the last setup
+static int is_stale(vertexarray* va)
+{
+	if (va->vertices->id != va->vertices_id || va->vertices->offset != va->vertices_offset)
+		return 1;
+	return NULL != va->indices && va->indices->id != va->indices_id;
+}
+
+static int l_vertexarray_draw(lua_State* L)
+{
+	vertexarray* va = l_checkvertexarray(L, 1);
+	GLenum mode = luaL_checkinteger(L, 2);
+
+	if (is_stale(va))
+		setup(va);
+
+	shader_bind_active();
+	glBindVertexArray(va->id);
+	glGetError();
+	if (NULL != va->indices)
+	{
+		bufferobject* ib = va->indices;
+		glDrawElements(mode, ib->count, ib->element_type, (GLvoid*)((char*)NULL + ib->offset));
+	}
+	else
+	{
+		glDrawArrays(mode, 0, va->vertices->count / va->stride);
+	}
+	GLenum error = glGetError();
+	glBindVertexArray(0);
+
+	if (GL_INVALID_ENUM == error)
+		return luaL_error(L, "Invalid draw mode");
+	return 0;
+}
+
+static int l_vertexarray_drawInstanced(lua_State* L)
+{
+	vertexarray* va = l_checkvertexarray(L, 1);
+	GLenum mode = luaL_checkinteger(L, 2);
+	GLsizei instances = luaL_checkinteger(L, 3);
+
+	assert_extension(L, ARB_draw_instanced);
+	if (instances < 0)
+		return luaL_error(L, "Invalid number of instances: %d", instances);
+
+	if (is_stale(va))
+		setup(va);
+
+	shader_bind_active();
+	glBindVertexArray(va->id);
+	glGetError();
+	if (NULL != va->indices)
+	{
+		bufferobject* ib = va->indices;
+		glDrawElementsInstanced(mode, ib->count, ib->element_type,
+		                        (GLvoid*)((char*)NULL + ib->offset), instances);
+	}
+	else
+	{
+		glDrawArraysInstanced(mode, 0, va->vertices->count / va->stride, instances);
+	}
+	GLenum error = glGetError();
+	glBindVertexArray(0);
+
+	if (GL_INVALID_ENUM == error)
+		return luaL_error(L, "Invalid draw mode");
+	return 0;
+}
+
+static int l_vertexarray___gc(lua_State* L)
+{
+	vertexarray* va = (vertexarray*)lua_touserdata(L, 1);
+
+	luaL_getmetatable(L, BUFFERS_NAME);
+	lua_pushnil(L);
+	lua_rawseti(L, -2, va->id);
+
+	glDeleteVertexArrays(1, &va->id);
+	return 0;
+}
+
+int l_vertexarray_new(lua_State* L)
+{
+	if (!context_available())
+		return luaL_error(L, "No OpenGL context available. Create a window first.");
+
+	assert_extension(L, ARB_vertex_array_object);
+
+	shader* s        = l_checkshader(L, 1);
+	bufferobject* vb = l_checkbufferobject(L, 2);
+	if (!lua_istable(L, 3))
+		return luaL_typerror(L, 3, "table");
+	bufferobject* ib = lua_isnoneornil(L, 4) ? NULL : l_checkbufferobject(L, 4);
+
+	if (GL_ARRAY_BUFFER != vb->target)
+		return luaL_error(L, "Vertex buffer must be an array buffer");
+	if (NULL != ib && GL_ELEMENT_ARRAY_BUFFER != ib->target)
+		return luaL_error(L, "Index buffer must be an element array buffer");
+
+	vertexarray* va = (vertexarray*)lua_newuserdata(L, sizeof(vertexarray));
+	va->vertices = vb;
+	va->indices = ib;
+	va->stride = 0;
+	va->attribute_count = 0;
+
+	// layout: {name1, size1, name2, size2, ...} in interleaved order.
+	// attributes not used by the shader are skipped.
+	int n = lua_objlen(L, 3);
+	if (n % 2 != 0)
+		return luaL_error(L, "Invalid layout: Expected name/size pairs");
+
+	for (int i = 1; i <= n; i += 2)
+	{
+		lua_rawgeti(L, 3, i);
+		lua_rawgeti(L, 3, i+1);
+		const char* name = lua_tostring(L, -2);
+		int size = lua_tointeger(L, -1);
+		if (NULL == name)
+			return luaL_error(L, "Invalid layout: Attribute name expected at %d", i);
+		if (size < 1 || size > 4)
+			return luaL_error(L, "Invalid layout: `%s' needs 1-4 elements.", name);
+
+		GLint location = glGetAttribLocation(s->id, name);
+		if (-1 != location)
+		{
+			if (va->attribute_count >= G4L_MAX_ATTRIBUTES)
+				return luaL_error(L, "Invalid layout: Too many attributes");
+
+			vertexattribute* a = &(va->attributes[va->attribute_count++]);
+			a->location = location;
+			a->size = size;
+			a->offset = va->stride;
+		}
+
+		va->stride += size;
+		lua_pop(L, 2);
+	}
+
+	if (0 == va->stride)
+		return luaL_error(L, "Invalid layout: No attributes");
+
+	glGenVertexArrays(1, &va->id);
+	setup(va);
+
+	if (luaL_newmetatable(L, INTERNAL_NAME))
+	{
+		luaL_reg meta[] =
+		{
+			{"__gc",          l_vertexarray___gc},
+			{"draw",          l_vertexarray_draw},
+			{"drawInstanced", l_vertexarray_drawInstanced},
+			{NULL, NULL}
+		};
+		l_registerFunctions(L, -1, meta);
+		lua_pushvalue(L, -1);
+		lua_setfield(L, -1, "__index");
+	}
+	lua_setmetatable(L, -2);
+
+	// keep buffers alive as long as the vertex array
+	luaL_newmetatable(L, BUFFERS_NAME);
+	lua_createtable(L, 2, 0);
+	lua_pushvalue(L, 2);
+	lua_rawseti(L, -2, 1);
+	if (NULL != ib)
+	{
+		lua_pushvalue(L, 4);
+		lua_rawseti(L, -2, 2);
+	}
+	lua_rawseti(L, -2, va->id);
+	lua_pop(L, 1);
+
+	return 1;
+}
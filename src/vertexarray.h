@@ -0,0 +1,37 @@
+#ifndef __G4L_VERTEXARRAY_H
+#define __G4L_VERTEXARRAY_H
+
+#include <glew.h>
+#include "bufferobject.h"
+
+#define G4L_MAX_ATTRIBUTES 16
+
+struct lua_State;
+
+typedef struct
+{
+	GLint   location;
+	GLint   size;
+	GLsizei offset;
+} vertexattribute;
+
+typedef struct
+{
+	GLuint        id;
+	bufferobject* vertices;
+	bufferobject* indices;
+
+	// buffer state the vertex array was set up with
+	GLuint   vertices_id;
+	GLintptr vertices_offset;
+	GLuint   indices_id;
+
+	GLsizei stride;
+	int     attribute_count;
+	vertexattribute attributes[G4L_MAX_ATTRIBUTES];
+} vertexarray;
+
+vertexarray* l_checkvertexarray(struct lua_State* L, int idx);
+int l_vertexarray_new(struct lua_State* L);
+
+#endif
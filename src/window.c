@@ -1,5 +1,6 @@
 #include "window.h"
 #include "helper.h"
+#include "shader.h"
 
 #include <lua.h>
 #include <lauxlib.h>
@@ -380,6 +381,8 @@ static void _reshape(int width, int height)
 
 static void _update()
 {
+	shader_reload_files(LUA);
+
 	int top = lua_gettop(LUA);
 
 	lua_pushstring(LUA, CALLBACKS_NAME);